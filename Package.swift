@@ -28,6 +28,12 @@ let package = Package(
             name: "CSTM32F4",
             targets: ["CSTM32F4"]
         ),
+        .library(
+            // Data structures and clock planning of the HAL library that do
+            // not depend on the hardware, buildable and testable on the host.
+            name: "STM32F4Support",
+            targets: ["STM32F4Support"]
+        ),
     ],
     dependencies: [
         .package(url: "https://github.com/swift-embedded/unicode-support", .branch("master")),
@@ -37,9 +43,16 @@ let package = Package(
     targets: [
         .target(
             name: "STM32F4",
-            dependencies: ["CSTM32F4", "Hardware"],
+            dependencies: ["CSTM32F4", "Hardware", "STM32F4Support"],
             cSettings: cSettings
         ),
+        .target(
+            name: "STM32F4Support",
+            dependencies: ["CMemoryBarrier"]
+        ),
+        .target(
+            name: "CMemoryBarrier"
+        ),
         .target(
             name: "STM32F4Startup",
             dependencies: ["Crt0", "SimpleUnicodeSupport"],
@@ -57,16 +70,28 @@ let package = Package(
                 "./hal/stm32f4xx_hal.c",
                 "./hal/stm32f4xx_hal_gpio.c",
                 "./hal/stm32f4xx_hal_rcc.c",
+                "./hal/stm32f4xx_hal_rcc_ex.c",
+                "./hal/stm32f4xx_hal_rtc.c",
+                "./hal/stm32f4xx_hal_rtc_ex.c",
                 "./hal/stm32f4xx_hal_cortex.c",
                 "./hal/stm32f4xx_hal_i2c.c",
                 "./hal/stm32f4xx_hal_i2c_ex.c",
                 "./hal/stm32f4xx_hal_dma.c",
+                "./hal/stm32f4xx_hal_fmpi2c.c",
+                "./hal/stm32f4xx_hal_fmpi2c_ex.c",
+                "./hal/stm32f4xx_hal_pwr.c",
                 "./hal/stm32f4xx_hal_pwr_ex.c",
                 "./hal/stm32f4xx_hal_spi.c",
+                "./hal/stm32f4xx_hal_tim.c",
+                "./hal/stm32f4xx_hal_tim_ex.c",
                 "./hal/stm32f4xx_hal_uart.c",
                 "./hal/stm32f4xx_ll_i2c.c",
             ],
             cSettings: cSettings + [.headerSearchPath(".")]
         ),
+        .testTarget(
+            name: "STM32F4SupportTests",
+            dependencies: ["STM32F4Support"]
+        ),
     ]
 )
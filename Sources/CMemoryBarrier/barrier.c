@@ -0,0 +1,2 @@
+// The barrier is inline in the header; a target needs at least one source.
+#include "CMemoryBarrier.h"
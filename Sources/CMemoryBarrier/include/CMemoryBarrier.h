@@ -0,0 +1,7 @@
+#pragma once
+
+/// Orders the memory accesses before the call with those after it: a DMB
+/// on the Cortex-M4, a full fence on the host.
+static inline void memory_barrier(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
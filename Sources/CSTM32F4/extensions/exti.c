@@ -0,0 +1,5 @@
+#include "CSTM32F4/CSTM32F4.h"
+
+// Zero-initialized in .bss before main, so the EXTI interrupt reads its
+// slots without going through a Swift lazy global initializer.
+EXTI_Slot EXTI_Slots[16];
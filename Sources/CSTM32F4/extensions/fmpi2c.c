@@ -0,0 +1,253 @@
+#include "stm32f4xx_hal_conf.h"
+#include <stdbool.h>
+
+// FMPI2C1 only exists on the F410, F412, F413/F423 and F446. Its HAL types
+// are not declared on other parts, so the Swift side goes through these
+// functions, which fail with HAL_ERROR when the peripheral is missing.
+
+void FMPI2C1_TransferCompleted(HAL_StatusTypeDef status); // fmpi2c.swift
+
+#if defined(FMPI2C1) && defined(HAL_FMPI2C_MODULE_ENABLED)
+
+static FMPI2C_HandleTypeDef handle;
+
+bool FMPI2C1_IsPresent(void)
+{
+    return true;
+}
+
+HAL_StatusTypeDef FMPI2C1_Init(uint32_t timing, bool fastModePlus)
+{
+    __HAL_RCC_FMPI2C1_CONFIG(RCC_FMPI2C1CLKSOURCE_PCLK1);
+    __HAL_RCC_FMPI2C1_CLK_ENABLE();
+
+    handle.Instance = FMPI2C1;
+    handle.Init.Timing = timing;
+    handle.Init.OwnAddress1 = 0;
+    handle.Init.AddressingMode = FMPI2C_ADDRESSINGMODE_7BIT;
+    handle.Init.DualAddressMode = FMPI2C_DUALADDRESS_DISABLE;
+    handle.Init.OwnAddress2 = 0;
+    handle.Init.OwnAddress2Masks = FMPI2C_OA2_NOMASK;
+    handle.Init.GeneralCallMode = FMPI2C_GENERALCALL_DISABLE;
+    handle.Init.NoStretchMode = FMPI2C_NOSTRETCH_DISABLE;
+    handle.State = HAL_FMPI2C_STATE_RESET;
+    if (HAL_FMPI2C_Init(&handle) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    if (HAL_FMPI2CEx_ConfigAnalogFilter(&handle, FMPI2C_ANALOGFILTER_ENABLE) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    // the 20 mA drive of the FM+ pads is needed above 400 kHz
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    if (fastModePlus) {
+        HAL_FMPI2CEx_EnableFastModePlus(FMPI2C_FASTMODEPLUS_SCL | FMPI2C_FASTMODEPLUS_SDA);
+    } else {
+        HAL_FMPI2CEx_DisableFastModePlus(FMPI2C_FASTMODEPLUS_SCL | FMPI2C_FASTMODEPLUS_SDA);
+    }
+
+    HAL_NVIC_SetPriority(FMPI2C1_EV_IRQn, 3, 0);
+    HAL_NVIC_EnableIRQ(FMPI2C1_EV_IRQn);
+    HAL_NVIC_SetPriority(FMPI2C1_ER_IRQn, 3, 0);
+    HAL_NVIC_EnableIRQ(FMPI2C1_ER_IRQn);
+    return HAL_OK;
+}
+
+void FMPI2C1_LinkDMA(DMA_HandleTypeDef *tx, DMA_HandleTypeDef *rx)
+{
+    __HAL_LINKDMA(&handle, hdmatx, *tx);
+    __HAL_LINKDMA(&handle, hdmarx, *rx);
+}
+
+uint32_t FMPI2C1_GetClockFrequency(void)
+{
+    return HAL_RCC_GetPCLK1Freq();
+}
+
+bool FMPI2C1_IsBusy(void)
+{
+    return HAL_FMPI2C_GetState(&handle) != HAL_FMPI2C_STATE_READY;
+}
+
+static HAL_StatusTypeDef errorStatus(uint32_t error)
+{
+    if (error == HAL_FMPI2C_ERROR_NONE) {
+        return HAL_OK;
+    }
+    return (error & HAL_FMPI2C_ERROR_TIMEOUT) ? HAL_TIMEOUT : HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_GetStatus(void)
+{
+    return errorStatus(HAL_FMPI2C_GetError(&handle));
+}
+
+static uint32_t transferOptions(bool first, bool stop)
+{
+    if (first) {
+        return stop ? FMPI2C_FIRST_AND_LAST_FRAME : FMPI2C_FIRST_FRAME;
+    }
+    return stop ? FMPI2C_LAST_FRAME : FMPI2C_NEXT_FRAME;
+}
+
+static uint16_t memoryAddressSize(uint16_t bytes)
+{
+    return bytes == 2 ? FMPI2C_MEMADD_SIZE_16BIT : FMPI2C_MEMADD_SIZE_8BIT;
+}
+
+HAL_StatusTypeDef FMPI2C1_Transmit(uint16_t address, const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return HAL_FMPI2C_Master_Transmit(&handle, address, (uint8_t *)data, size, timeout);
+}
+
+HAL_StatusTypeDef FMPI2C1_Receive(uint16_t address, uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return HAL_FMPI2C_Master_Receive(&handle, address, data, size, timeout);
+}
+
+HAL_StatusTypeDef FMPI2C1_Transmit_IT(uint16_t address, const uint8_t *data, uint16_t size, bool first, bool stop)
+{
+    return HAL_FMPI2C_Master_Sequential_Transmit_IT(&handle, address, (uint8_t *)data, size,
+                                                    transferOptions(first, stop));
+}
+
+HAL_StatusTypeDef FMPI2C1_Receive_IT(uint16_t address, uint8_t *data, uint16_t size, bool first, bool stop)
+{
+    return HAL_FMPI2C_Master_Sequential_Receive_IT(&handle, address, data, size,
+                                                   transferOptions(first, stop));
+}
+
+HAL_StatusTypeDef FMPI2C1_Transmit_DMA(uint16_t address, const uint8_t *data, uint16_t size)
+{
+    return HAL_FMPI2C_Master_Transmit_DMA(&handle, address, (uint8_t *)data, size);
+}
+
+HAL_StatusTypeDef FMPI2C1_Receive_DMA(uint16_t address, uint8_t *data, uint16_t size)
+{
+    return HAL_FMPI2C_Master_Receive_DMA(&handle, address, data, size);
+}
+
+HAL_StatusTypeDef FMPI2C1_MemWrite(uint16_t address, uint16_t memoryAddress, uint16_t memoryAddressBytes,
+                                   const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return HAL_FMPI2C_Mem_Write(&handle, address, memoryAddress, memoryAddressSize(memoryAddressBytes),
+                                (uint8_t *)data, size, timeout);
+}
+
+HAL_StatusTypeDef FMPI2C1_MemRead(uint16_t address, uint16_t memoryAddress, uint16_t memoryAddressBytes,
+                                  uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return HAL_FMPI2C_Mem_Read(&handle, address, memoryAddress, memoryAddressSize(memoryAddressBytes),
+                               data, size, timeout);
+}
+
+HAL_StatusTypeDef FMPI2C1_IsDeviceReady(uint16_t address, uint32_t trials, uint32_t timeout)
+{
+    return HAL_FMPI2C_IsDeviceReady(&handle, address, trials, timeout);
+}
+
+void FMPI2C1_EV_IRQHandler(void)
+{
+    HAL_FMPI2C_EV_IRQHandler(&handle);
+}
+
+void FMPI2C1_ER_IRQHandler(void)
+{
+    HAL_FMPI2C_ER_IRQHandler(&handle);
+}
+
+void HAL_FMPI2C_MasterTxCpltCallback(FMPI2C_HandleTypeDef *hfmpi2c)
+{
+    FMPI2C1_TransferCompleted(HAL_OK);
+}
+
+void HAL_FMPI2C_MasterRxCpltCallback(FMPI2C_HandleTypeDef *hfmpi2c)
+{
+    FMPI2C1_TransferCompleted(HAL_OK);
+}
+
+void HAL_FMPI2C_ErrorCallback(FMPI2C_HandleTypeDef *hfmpi2c)
+{
+    HAL_StatusTypeDef status = errorStatus(hfmpi2c->ErrorCode);
+    FMPI2C1_TransferCompleted(status != HAL_OK ? status : HAL_ERROR);
+}
+
+#else
+
+bool FMPI2C1_IsPresent(void)
+{
+    return false;
+}
+
+HAL_StatusTypeDef FMPI2C1_Init(uint32_t timing, bool fastModePlus)
+{
+    return HAL_ERROR;
+}
+
+void FMPI2C1_LinkDMA(DMA_HandleTypeDef *tx, DMA_HandleTypeDef *rx)
+{
+}
+
+uint32_t FMPI2C1_GetClockFrequency(void)
+{
+    return 0;
+}
+
+bool FMPI2C1_IsBusy(void)
+{
+    return false;
+}
+
+HAL_StatusTypeDef FMPI2C1_GetStatus(void)
+{
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_Transmit(uint16_t address, const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_Receive(uint16_t address, uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_Transmit_IT(uint16_t address, const uint8_t *data, uint16_t size, bool first, bool stop)
+{
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_Receive_IT(uint16_t address, uint8_t *data, uint16_t size, bool first, bool stop)
+{
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_Transmit_DMA(uint16_t address, const uint8_t *data, uint16_t size)
+{
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_Receive_DMA(uint16_t address, uint8_t *data, uint16_t size)
+{
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_MemWrite(uint16_t address, uint16_t memoryAddress, uint16_t memoryAddressBytes,
+                                   const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_MemRead(uint16_t address, uint16_t memoryAddress, uint16_t memoryAddressBytes,
+                                  uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef FMPI2C1_IsDeviceReady(uint16_t address, uint32_t trials, uint32_t timeout)
+{
+    return HAL_ERROR;
+}
+
+#endif
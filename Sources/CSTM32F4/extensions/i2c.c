@@ -5,7 +5,10 @@
 #define I2C1_SCL_PIN (1 << 8)
 #define I2C1_SDA_PIN (1 << 9)
 
-void I2C1_ClearBusyFlagErratum(I2C_HandleTypeDef *instance)
+HAL_StatusTypeDef I2C_ClearBusyFlagErratum(I2C_HandleTypeDef *instance,
+                                           GPIO_TypeDef *sclPort, uint16_t sclPin,
+                                           GPIO_TypeDef *sdaPort, uint16_t sdaPin,
+                                           uint32_t alternate)
 {
     GPIO_InitTypeDef GPIO_InitStruct;
     int timeout =100;
@@ -16,97 +19,97 @@ void I2C1_ClearBusyFlagErratum(I2C_HandleTypeDef *instance)
 
     //  2. Configure the SCL and SDA I/Os as General Purpose Output Open-Drain, High level (Write 1 to GPIOx_ODR).
     GPIO_InitStruct.Mode         = GPIO_MODE_OUTPUT_OD;
-    GPIO_InitStruct.Alternate    = GPIO_AF4_I2C1;
+    GPIO_InitStruct.Alternate    = alternate;
     GPIO_InitStruct.Pull         = GPIO_PULLUP;
     GPIO_InitStruct.Speed        = GPIO_SPEED_FREQ_HIGH;
 
-    GPIO_InitStruct.Pin          = I2C1_SCL_PIN;
-    HAL_GPIO_Init(I2C1_SCL_PORT, &GPIO_InitStruct);
-    HAL_GPIO_WritePin(I2C1_SCL_PORT, I2C1_SCL_PIN, GPIO_PIN_SET);
+    GPIO_InitStruct.Pin          = sclPin;
+    HAL_GPIO_Init(sclPort, &GPIO_InitStruct);
+    HAL_GPIO_WritePin(sclPort, sclPin, GPIO_PIN_SET);
 
-    GPIO_InitStruct.Pin          = I2C1_SDA_PIN;
-    HAL_GPIO_Init(I2C1_SDA_PORT, &GPIO_InitStruct);
-    HAL_GPIO_WritePin(I2C1_SDA_PORT, I2C1_SDA_PIN, GPIO_PIN_SET);
+    GPIO_InitStruct.Pin          = sdaPin;
+    HAL_GPIO_Init(sdaPort, &GPIO_InitStruct);
+    HAL_GPIO_WritePin(sdaPort, sdaPin, GPIO_PIN_SET);
 
 
     // 3. Check SCL and SDA High level in GPIOx_IDR.
-    while (GPIO_PIN_SET != HAL_GPIO_ReadPin(I2C1_SCL_PORT, I2C1_SCL_PIN))
+    while (GPIO_PIN_SET != HAL_GPIO_ReadPin(sclPort, sclPin))
     {
         timeout_cnt++;
         if(timeout_cnt>timeout)
-            return;
+            return HAL_TIMEOUT;
     }
 
-    while (GPIO_PIN_SET != HAL_GPIO_ReadPin(I2C1_SDA_PORT, I2C1_SDA_PIN))
+    while (GPIO_PIN_SET != HAL_GPIO_ReadPin(sdaPort, sdaPin))
     {
         //Move clock to release I2C
-        HAL_GPIO_WritePin(I2C1_SCL_PORT, I2C1_SCL_PIN, GPIO_PIN_RESET);
+        HAL_GPIO_WritePin(sclPort, sclPin, GPIO_PIN_RESET);
         asm("nop");
-        HAL_GPIO_WritePin(I2C1_SCL_PORT, I2C1_SCL_PIN, GPIO_PIN_SET);
+        HAL_GPIO_WritePin(sclPort, sclPin, GPIO_PIN_SET);
 
         timeout_cnt++;
         if(timeout_cnt>timeout)
-            return;
+            return HAL_TIMEOUT;
     }
 
     // 4. Configure the SDA I/O as General Purpose Output Open-Drain, Low level (Write 0 to GPIOx_ODR).
-    HAL_GPIO_WritePin(I2C1_SDA_PORT, I2C1_SDA_PIN, GPIO_PIN_RESET);
+    HAL_GPIO_WritePin(sdaPort, sdaPin, GPIO_PIN_RESET);
 
     //  5. Check SDA Low level in GPIOx_IDR.
-    while (GPIO_PIN_RESET != HAL_GPIO_ReadPin(I2C1_SDA_PORT, I2C1_SDA_PIN))
+    while (GPIO_PIN_RESET != HAL_GPIO_ReadPin(sdaPort, sdaPin))
     {
         timeout_cnt++;
         if(timeout_cnt>timeout)
-            return;
+            return HAL_TIMEOUT;
     }
 
     // 6. Configure the SCL I/O as General Purpose Output Open-Drain, Low level (Write 0 to GPIOx_ODR).
-    HAL_GPIO_WritePin(I2C1_SCL_PORT, I2C1_SCL_PIN, GPIO_PIN_RESET);
+    HAL_GPIO_WritePin(sclPort, sclPin, GPIO_PIN_RESET);
 
     //  7. Check SCL Low level in GPIOx_IDR.
-    while (GPIO_PIN_RESET != HAL_GPIO_ReadPin(I2C1_SCL_PORT, I2C1_SCL_PIN))
+    while (GPIO_PIN_RESET != HAL_GPIO_ReadPin(sclPort, sclPin))
     {
         timeout_cnt++;
         if(timeout_cnt>timeout)
-            return;
+            return HAL_TIMEOUT;
     }
 
     // 8. Configure the SCL I/O as General Purpose Output Open-Drain, High level (Write 1 to GPIOx_ODR).
-    HAL_GPIO_WritePin(I2C1_SCL_PORT, I2C1_SCL_PIN, GPIO_PIN_SET);
+    HAL_GPIO_WritePin(sclPort, sclPin, GPIO_PIN_SET);
 
     // 9. Check SCL High level in GPIOx_IDR.
-    while (GPIO_PIN_SET != HAL_GPIO_ReadPin(I2C1_SCL_PORT, I2C1_SCL_PIN))
+    while (GPIO_PIN_SET != HAL_GPIO_ReadPin(sclPort, sclPin))
     {
         timeout_cnt++;
         if(timeout_cnt>timeout)
-            return;
+            return HAL_TIMEOUT;
     }
 
     // 10. Configure the SDA I/O as General Purpose Output Open-Drain , High level (Write 1 to GPIOx_ODR).
-    HAL_GPIO_WritePin(I2C1_SDA_PORT, I2C1_SDA_PIN, GPIO_PIN_SET);
+    HAL_GPIO_WritePin(sdaPort, sdaPin, GPIO_PIN_SET);
 
     // 11. Check SDA High level in GPIOx_IDR.
-    while (GPIO_PIN_SET != HAL_GPIO_ReadPin(I2C1_SDA_PORT, I2C1_SDA_PIN))
+    while (GPIO_PIN_SET != HAL_GPIO_ReadPin(sdaPort, sdaPin))
     {
         timeout_cnt++;
         if(timeout_cnt>timeout)
-            return;
+            return HAL_TIMEOUT;
     }
 
     // 12. Configure the SCL and SDA I/Os as Alternate function Open-Drain.
     GPIO_InitStruct.Mode = GPIO_MODE_AF_OD;
     GPIO_InitStruct.Pull = GPIO_PULLUP;
     GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-    GPIO_InitStruct.Alternate = GPIO_AF4_I2C1;
+    GPIO_InitStruct.Alternate = alternate;
 
-    GPIO_InitStruct.Pin = I2C1_SCL_PIN;
-    HAL_GPIO_Init(I2C1_SCL_PORT, &GPIO_InitStruct);
+    GPIO_InitStruct.Pin = sclPin;
+    HAL_GPIO_Init(sclPort, &GPIO_InitStruct);
 
-    GPIO_InitStruct.Pin = I2C1_SDA_PIN;
-    HAL_GPIO_Init(I2C1_SDA_PORT, &GPIO_InitStruct);
+    GPIO_InitStruct.Pin = sdaPin;
+    HAL_GPIO_Init(sdaPort, &GPIO_InitStruct);
 
-    HAL_GPIO_WritePin(I2C1_SCL_PORT, I2C1_SCL_PIN, GPIO_PIN_SET);
-    HAL_GPIO_WritePin(I2C1_SDA_PORT, I2C1_SDA_PIN, GPIO_PIN_SET);
+    HAL_GPIO_WritePin(sclPort, sclPin, GPIO_PIN_SET);
+    HAL_GPIO_WritePin(sdaPort, sdaPin, GPIO_PIN_SET);
 
     // 13. Set SWRST bit in I2Cx_CR1 register.
     instance->Instance->CR1 |= 0x8000;
@@ -122,5 +125,11 @@ void I2C1_ClearBusyFlagErratum(I2C_HandleTypeDef *instance)
     instance->Instance->CR1 |= 0x0001;
 
     // Call initialization function.
-    HAL_I2C_Init(instance);
+    return HAL_I2C_Init(instance);
+}
+
+void I2C1_ClearBusyFlagErratum(I2C_HandleTypeDef *instance)
+{
+    I2C_ClearBusyFlagErratum(instance, I2C1_SCL_PORT, I2C1_SCL_PIN,
+                             I2C1_SDA_PORT, I2C1_SDA_PIN, GPIO_AF4_I2C1);
 }
@@ -2,8 +2,12 @@
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wnullability-completeness"
 
+#include <stdbool.h>
+
 #include "stm32f4xx_hal.h"
+#include "stm32f4xx_ll_gpio.h"
 #include "stm32f4xx_ll_i2c.h"
+#include "stm32f4xx_ll_spi.h"
 
 #define EXPORT_MACRO_ARG0(rettype, name)                                       \
   static inline rettype m##name(void) { name(); }
@@ -11,9 +15,17 @@
 #define EXPORT_MACRO_ARG1(rettype, name, arg1type)                             \
   static inline rettype m##name(arg1type arg1) { name(arg1); }
 
+#define EXPORT_MACRO_ARG2(rettype, name, arg1type, arg2type)                   \
+  static inline rettype m##name(arg1type arg1, arg2type arg2) {                \
+    return name(arg1, arg2);                                                   \
+  }
+
 #define EXPORT_MACRO_CONST(type, name) static const type m_##name = name;
 
 EXPORT_MACRO_CONST(uint32_t, SPI_MODE_MASTER)
+EXPORT_MACRO_CONST(uint8_t, RCC_LSI_ON)
+EXPORT_MACRO_CONST(uint8_t, PWR_SLEEPENTRY_WFI)
+EXPORT_MACRO_CONST(uint8_t, PWR_STOPENTRY_WFI)
 
 EXPORT_MACRO_ARG0(void, __PWR_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_GPIOA_CLK_ENABLE)
@@ -29,17 +41,83 @@ EXPORT_MACRO_ARG0(void, __HAL_RCC_GPIOJ_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_GPIOK_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_I2C1_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_I2C2_CLK_ENABLE)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_I2C3_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_SPI1_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_SPI2_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_SPI3_CLK_ENABLE)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_SPI1_FORCE_RESET)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_SPI2_FORCE_RESET)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_SPI3_FORCE_RESET)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_SPI1_RELEASE_RESET)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_SPI2_RELEASE_RESET)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_SPI3_RELEASE_RESET)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_TIM1_CLK_ENABLE)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_TIM2_CLK_ENABLE)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_TIM6_CLK_ENABLE)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_TIM7_CLK_ENABLE)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_TIM8_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_USART1_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_USART2_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_USART3_CLK_ENABLE)
 EXPORT_MACRO_ARG0(void, __HAL_RCC_USART6_CLK_ENABLE)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_DMA1_CLK_ENABLE)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_DMA2_CLK_ENABLE)
+EXPORT_MACRO_ARG0(void, __HAL_RCC_RTC_ENABLE)
 
 EXPORT_MACRO_ARG1(void, __HAL_PWR_VOLTAGESCALING_CONFIG, uint32_t)
 
+EXPORT_MACRO_ARG2(uint32_t, UART_BRR_SAMPLING8, uint32_t, uint32_t)
+EXPORT_MACRO_ARG2(uint32_t, UART_BRR_SAMPLING16, uint32_t, uint32_t)
+
+// the HAL tick counter, advanced after a tickless idle (stm32f4xx_hal.c)
+extern __IO uint32_t uwTick;
+
 void I2C1_ClearBusyFlagErratum(I2C_HandleTypeDef *instance); // i2c.c
+HAL_StatusTypeDef I2C_ClearBusyFlagErratum(I2C_HandleTypeDef *instance,
+                                           GPIO_TypeDef *sclPort, uint16_t sclPin,
+                                           GPIO_TypeDef *sdaPort, uint16_t sdaPin,
+                                           uint32_t alternate); // i2c.c
+
+// The handler of each EXTI line (exti.c). A line in capture mode has a
+// port, and its context is the unretained queue the edges are recorded in.
+typedef struct {
+  void (*function)(void *context);
+  void *context;
+  GPIO_TypeDef *capturePort;
+} EXTI_Slot;
+
+extern EXTI_Slot EXTI_Slots[16];
+
+static inline EXTI_Slot *EXTI_GetSlot(uint32_t line) { return &EXTI_Slots[line]; }
+
+// FMPI2C1, fail with HAL_ERROR on parts without the peripheral (fmpi2c.c)
+bool FMPI2C1_IsPresent(void);
+HAL_StatusTypeDef FMPI2C1_Init(uint32_t timing, bool fastModePlus);
+void FMPI2C1_LinkDMA(DMA_HandleTypeDef *tx, DMA_HandleTypeDef *rx);
+uint32_t FMPI2C1_GetClockFrequency(void);
+bool FMPI2C1_IsBusy(void);
+HAL_StatusTypeDef FMPI2C1_GetStatus(void);
+HAL_StatusTypeDef FMPI2C1_Transmit(uint16_t address, const uint8_t *data,
+                                   uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef FMPI2C1_Receive(uint16_t address, uint8_t *data,
+                                  uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef FMPI2C1_Transmit_IT(uint16_t address, const uint8_t *data,
+                                      uint16_t size, bool first, bool stop);
+HAL_StatusTypeDef FMPI2C1_Receive_IT(uint16_t address, uint8_t *data,
+                                     uint16_t size, bool first, bool stop);
+HAL_StatusTypeDef FMPI2C1_Transmit_DMA(uint16_t address, const uint8_t *data,
+                                       uint16_t size);
+HAL_StatusTypeDef FMPI2C1_Receive_DMA(uint16_t address, uint8_t *data,
+                                      uint16_t size);
+HAL_StatusTypeDef FMPI2C1_MemWrite(uint16_t address, uint16_t memoryAddress,
+                                   uint16_t memoryAddressBytes,
+                                   const uint8_t *data, uint16_t size,
+                                   uint32_t timeout);
+HAL_StatusTypeDef FMPI2C1_MemRead(uint16_t address, uint16_t memoryAddress,
+                                  uint16_t memoryAddressBytes, uint8_t *data,
+                                  uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef FMPI2C1_IsDeviceReady(uint16_t address, uint32_t trials,
+                                        uint32_t timeout);
 
 static inline HAL_StatusTypeDef _HAL_SPI_Transmit(SPI_HandleTypeDef *hspi,
                                                   const uint8_t *pData,
@@ -48,6 +126,39 @@ static inline HAL_StatusTypeDef _HAL_SPI_Transmit(SPI_HandleTypeDef *hspi,
   return HAL_SPI_Transmit(hspi, (uint8_t *)pData, Size, Timeout);
 }
 
+static inline HAL_StatusTypeDef _HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi,
+                                                         const uint8_t *pTxData,
+                                                         uint8_t *pRxData,
+                                                         uint16_t Size,
+                                                         uint32_t Timeout) {
+  return HAL_SPI_TransmitReceive(hspi, (uint8_t *)pTxData, pRxData, Size,
+                                 Timeout);
+}
+
+static inline HAL_StatusTypeDef _HAL_SPI_Transmit_IT(SPI_HandleTypeDef *hspi,
+                                                     const uint8_t *pData,
+                                                     uint16_t Size) {
+  return HAL_SPI_Transmit_IT(hspi, (uint8_t *)pData, Size);
+}
+
+static inline HAL_StatusTypeDef
+_HAL_SPI_TransmitReceive_IT(SPI_HandleTypeDef *hspi, const uint8_t *pTxData,
+                            uint8_t *pRxData, uint16_t Size) {
+  return HAL_SPI_TransmitReceive_IT(hspi, (uint8_t *)pTxData, pRxData, Size);
+}
+
+static inline HAL_StatusTypeDef _HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi,
+                                                      const uint8_t *pData,
+                                                      uint16_t Size) {
+  return HAL_SPI_Transmit_DMA(hspi, (uint8_t *)pData, Size);
+}
+
+static inline HAL_StatusTypeDef
+_HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, const uint8_t *pTxData,
+                             uint8_t *pRxData, uint16_t Size) {
+  return HAL_SPI_TransmitReceive_DMA(hspi, (uint8_t *)pTxData, pRxData, Size);
+}
+
 static inline HAL_StatusTypeDef _HAL_UART_Transmit(UART_HandleTypeDef *huart,
                                                    const uint8_t *pData,
                                                    uint16_t Size,
@@ -55,6 +166,12 @@ static inline HAL_StatusTypeDef _HAL_UART_Transmit(UART_HandleTypeDef *huart,
   return HAL_UART_Transmit(huart, (uint8_t *)pData, Size, Timeout);
 }
 
+static inline HAL_StatusTypeDef _HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart,
+                                                       const uint8_t *pData,
+                                                       uint16_t Size) {
+  return HAL_UART_Transmit_DMA(huart, (uint8_t *)pData, Size);
+}
+
 static inline HAL_StatusTypeDef
 _HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
                          const uint8_t *pData, uint16_t Size,
@@ -63,11 +180,25 @@ _HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
                                  Timeout);
 }
 
+static inline HAL_StatusTypeDef _HAL_I2C_Master_Sequential_Transmit_IT(
+    I2C_HandleTypeDef *hi2c, uint16_t DevAddress, const uint8_t *pData,
+    uint16_t Size, uint32_t XferOptions) {
+  return HAL_I2C_Master_Sequential_Transmit_IT(hi2c, DevAddress,
+                                               (uint8_t *)pData, Size,
+                                               XferOptions);
+}
+
+static inline HAL_StatusTypeDef
+_HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
+                             const uint8_t *pData, uint16_t Size) {
+  return HAL_I2C_Master_Transmit_DMA(hi2c, DevAddress, (uint8_t *)pData, Size);
+}
+
 static inline HAL_StatusTypeDef
 _HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
                    uint16_t MemAddress, uint16_t MemAddSize,
                    const uint8_t *pData, uint16_t Size, uint32_t Timeout) {
-  return HAL_I2C_Mem_Write(hi2c, DevAddress, MemAddSize, MemAddSize,
+  return HAL_I2C_Mem_Write(hi2c, DevAddress, MemAddress, MemAddSize,
                            (uint8_t *)pData, Size, Timeout);
 }
 
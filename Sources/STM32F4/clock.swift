@@ -1,33 +1,169 @@
 import CSTM32F4
+import STM32F4Support
+
+/// A peripheral whose timing derives from the bus clocks. Observers are
+/// told when `STM32F4.setClock` changes the clock tree.
+public protocol ClockObserver: AnyObject {
+    /// Called before the clocks change to `tree`, to let transfers in
+    /// progress finish or to refuse a tree the peripheral cannot run from.
+    /// Throwing cancels the change.
+    func clockWillChange(to tree: ClockTree) throws
+
+    /// Called once the new clocks run, to reprogram dividers.
+    func clockDidChange(to tree: ClockTree)
+}
+
+extension ClockObserver {
+    public func clockWillChange(to tree: ClockTree) throws {}
+}
+
+extension STM32F4 {
+    /// Switches to `tree`, e.g. down to 24 MHz while idle and back up for
+    /// bursts. The UARTs, SPIs, I2Cs and timers keep their baud rates and
+    /// frequencies, to the resolution of their dividers, as do SysTick and
+    /// the registered observers.
+    public func setClock(_ tree: ClockTree) throws {
+        try Clock.change(to: tree)
+    }
+
+    public func addClockObserver(_ observer: ClockObserver) {
+        Clock.observers.append(observer)
+    }
+
+    public func removeClockObserver(_ observer: ClockObserver) {
+        Clock.observers.removeAll { $0 === observer }
+    }
+}
 
 final class Clock {
-    static func setup() throws {
+    /// The clock tree set up by the last `setup`.
+    private(set) static var tree = ClockTree.discovery
+
+    static var observers: [ClockObserver] = []
+
+    private static var overDriveEnabled = false
+
+    private static var flash: UnsafeMutablePointer<FLASH_TypeDef> {
+        return UnsafeMutablePointer<FLASH_TypeDef>(bitPattern: UInt(FLASH_R_BASE))!
+    }
+
+    static func change(to tree: ClockTree) throws {
+        for observer in observers {
+            try observer.clockWillChange(to: tree)
+        }
+        try setup(tree)
+        for observer in observers {
+            observer.clockDidChange(to: tree)
+        }
+    }
+
+    /// Restarts the clock tree after STOP mode, which leaves the core on HSI
+    /// with HSE, the PLL and over-drive off.
+    static func restoreAfterStop() throws {
+        overDriveEnabled = false
+        try setup(tree)
+    }
+
+    /// Sets up `tree` from any state. SYSCLK runs from HSI while the PLL is
+    /// reprogrammed; the regulator scale can only change with the PLL off,
+    /// and `HAL_RCC_ClockConfig` raises the flash wait states before the
+    /// switch to a faster clock and lowers them after a switch to a slower
+    /// one.
+    static func setup(_ tree: ClockTree = .discovery) throws {
         m__PWR_CLK_ENABLE()
-        m__HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE1)
+
+        var clkInit = RCC_ClkInitTypeDef()
+        clkInit.ClockType = RCC_CLOCKTYPE_SYSCLK
+        clkInit.SYSCLKSource = RCC_SYSCLKSOURCE_HSI
+        try HAL_RCC_ClockConfig(&clkInit, flash.pointee.ACR & FLASH_ACR_LATENCY).throwOnFailure()
+
+        if overDriveEnabled && !tree.overDrive {
+            try HAL_PWREx_DisableOverDrive().throwOnFailure()
+            overDriveEnabled = false
+        }
 
         var oscInit = RCC_OscInitTypeDef()
-        oscInit.OscillatorType = RCC_OSCILLATORTYPE_HSE
-        oscInit.HSEState = UInt32(RCC_CR_HSEBYP | RCC_CR_HSEON)
+        oscInit.OscillatorType = RCC_OSCILLATORTYPE_NONE
+        oscInit.PLL.PLLState = UInt32(RCC_PLL_OFF)
+        try HAL_RCC_OscConfig(&oscInit).throwOnFailure()
+
+        m__HAL_PWR_VOLTAGESCALING_CONFIG(tree.regulatorVoltageScale)
+
+        oscInit = RCC_OscInitTypeDef()
+        switch tree.source {
+        case .hsi:
+            oscInit.OscillatorType = RCC_OSCILLATORTYPE_HSI
+            oscInit.HSIState = UInt32(RCC_CR_HSION)
+            oscInit.PLL.PLLSource = RCC_PLLSOURCE_HSI
+        case .hse(_, let bypass):
+            oscInit.OscillatorType = RCC_OSCILLATORTYPE_HSE
+            oscInit.HSEState = UInt32(bypass ? RCC_CR_HSEBYP | RCC_CR_HSEON : RCC_CR_HSEON)
+            oscInit.PLL.PLLSource = RCC_PLLSOURCE_HSE
+        }
         oscInit.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT
-        oscInit.PLL.PLLSource = RCC_PLLSOURCE_HSE
         oscInit.PLL.PLLState = UInt32(RCC_PLL_ON)
-        oscInit.PLL.PLLM = 8
-        oscInit.PLL.PLLN = 336
-        oscInit.PLL.PLLP = RCC_PLLP_DIV2
-        oscInit.PLL.PLLQ = 7
+        oscInit.PLL.PLLM = UInt32(tree.pllM)
+        oscInit.PLL.PLLN = UInt32(tree.pllN)
+        oscInit.PLL.PLLP = UInt32(tree.pllP)
+        oscInit.PLL.PLLQ = UInt32(tree.pllQ)
         try HAL_RCC_OscConfig(&oscInit).throwOnFailure()
 
-        try HAL_PWREx_EnableOverDrive().throwOnFailure()
+        if tree.overDrive && !overDriveEnabled {
+            try HAL_PWREx_EnableOverDrive().throwOnFailure()
+            overDriveEnabled = true
+        }
 
-        var clkInit = RCC_ClkInitTypeDef()
+        clkInit = RCC_ClkInitTypeDef()
         clkInit.ClockType = RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2
         clkInit.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK
-        clkInit.AHBCLKDivider = RCC_SYSCLK_DIV1
-        clkInit.APB1CLKDivider = RCC_HCLK_DIV4
-        clkInit.APB2CLKDivider = RCC_HCLK_DIV2
-        try HAL_RCC_ClockConfig(&clkInit, FLASH_LATENCY_5).throwOnFailure()
+        clkInit.AHBCLKDivider = tree.ahbPrescaler
+        clkInit.APB1CLKDivider = ClockTree.apbPrescaler(tree.apb1Divider)
+        clkInit.APB2CLKDivider = ClockTree.apbPrescaler(tree.apb2Divider)
+        try HAL_RCC_ClockConfig(&clkInit, UInt32(tree.flashLatency)).throwOnFailure()
+
+        if let n = tree.pllI2SN, let r = tree.pllI2SR {
+            var periphInit = RCC_PeriphCLKInitTypeDef()
+            periphInit.PeriphClockSelection = RCC_PERIPHCLK_I2S
+            periphInit.PLLI2S.PLLI2SN = UInt32(n)
+            periphInit.PLLI2S.PLLI2SR = UInt32(r)
+            try HAL_RCCEx_PeriphCLKConfig(&periphInit).throwOnFailure()
+        }
+
+        // the HAL derives SystemCoreClock from HSE_VALUE, which only holds
+        // for 8 MHz sources
+        SystemCoreClock = UInt32(tree.hclk)
+        self.tree = tree
 
         HAL_SYSTICK_Config(HAL_RCC_GetHCLKFreq() / 1000)
         HAL_SYSTICK_CLKSourceConfig(SYSTICK_CLKSOURCE_HCLK)
     }
 }
+
+extension ClockTree {
+    var regulatorVoltageScale: UInt32 {
+        switch voltageScale {
+        case 1: return PWR_REGULATOR_VOLTAGE_SCALE1
+        case 2: return PWR_REGULATOR_VOLTAGE_SCALE2
+        default: return PWR_REGULATOR_VOLTAGE_SCALE3
+        }
+    }
+
+    /// The RCC_CFGR HPRE field for `ahbDivider`.
+    var ahbPrescaler: UInt32 {
+        if ahbDivider == 1 {
+            return RCC_SYSCLK_DIV1
+        }
+        // /2 to /16 are 0b1000 to 0b1011, /64 to /512 are 0b1100 to 0b1111
+        let log2 = UInt32(ahbDivider.trailingZeroBitCount)
+        return (0b1000 | (log2 > 4 ? log2 - 2 : log2 - 1)) << 4
+    }
+
+    /// The RCC_CFGR PPRE1 field for an APB divider; the HAL shifts it for
+    /// PPRE2.
+    static func apbPrescaler(_ divider: Int) -> UInt32 {
+        if divider == 1 {
+            return RCC_HCLK_DIV1
+        }
+        return (0b100 | UInt32(divider.trailingZeroBitCount - 1)) << 10
+    }
+}
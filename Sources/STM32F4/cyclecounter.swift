@@ -0,0 +1,24 @@
+import CSTM32F4
+
+/// The core's cycle counter (DWT CYCCNT), incremented at the CPU clock and
+/// wrapping every 2^32 cycles.
+public enum CycleCounter {
+    @usableFromInline
+    static let dwt = UnsafeMutablePointer<DWT_Type>(bitPattern: UInt(DWT_BASE))!
+
+    /// Starts the counter. It keeps its current value if already running.
+    public static func enable() {
+        let debug = UnsafeMutablePointer<CoreDebug_Type>(bitPattern: UInt(CoreDebug_BASE))!
+        debug.pointee.DEMCR |= CoreDebug_DEMCR_TRCENA_Msk
+        dwt.pointee.CTRL |= DWT_CTRL_CYCCNTENA_Msk
+    }
+
+    public static var isEnabled: Bool {
+        return dwt.pointee.CTRL & DWT_CTRL_CYCCNTENA_Msk != 0
+    }
+
+    @inlinable
+    public static var now: UInt32 {
+        return dwt.pointee.CYCCNT
+    }
+}
@@ -0,0 +1,159 @@
+import CSTM32F4
+import STM32F4Support
+
+/// Debounces buttons and switches by sampling whole ports from a timer
+/// tick, instead of taking an interrupt on every bounce.
+///
+/// Each port is debounced 16 pins at a time with vertical counters: a pin
+/// changes state after 4 consecutive samples that differ from it. Events
+/// are queued for the application to drain, nothing runs in interrupt
+/// context besides the scan.
+public final class Debouncer {
+    public struct Event {
+        public enum Kind {
+            case pressed
+            case released
+            /// The pin has been pressed for `longPress` samples. Reported once
+            /// per press, before the release.
+            case longPressed
+        }
+
+        public let kind: Kind
+        /// The index returned by `watch`.
+        public let group: Int
+        public let pin: Int
+        /// The number of samples taken before the event.
+        public let sample: UInt32
+    }
+
+    final class Port {
+        let group: GPIO.PinGroup
+        let activeLow: Bool
+
+        /// Debounced state, 1 = pressed.
+        var state: UInt16 = 0
+        /// The two bits of each pin's counter.
+        var count0: UInt16 = 0xFFFF
+        var count1: UInt16 = 0xFFFF
+        /// Pins whose long press has been reported.
+        var longReported: UInt16 = 0
+        /// The sample at which each pin was pressed.
+        var pressedAt = [UInt32](repeating: 0, count: 16)
+
+        init(group: GPIO.PinGroup, activeLow: Bool) {
+            self.group = group
+            self.activeLow = activeLow
+        }
+    }
+
+    public let timer: TIM
+    /// Samples a pin must stay pressed to report a long press.
+    public let longPress: UInt32
+
+    private var ports: [Port] = []
+    private let events: RingBuffer<Event>
+    private var sample: UInt32 = 0
+
+    /// Number of events lost because the queue was full.
+    public private(set) var dropped = 0
+
+    /// The sampling frequency actually reached.
+    public private(set) var sampleRate = 0
+
+    /// Samples at `sampleRate` Hz from `timer`, which must have an update
+    /// interrupt (e.g. TIM6 or TIM7). At the default 1 kHz a press is
+    /// reported 4 ms after the contact settles, and a long press after
+    /// `longPress` seconds.
+    public init(timer: TIM, sampleRate: Int = 1000, longPress: Double = 1, queueCapacity: Int = 32) throws {
+        self.timer = timer
+        events = RingBuffer<Event>(capacity: queueCapacity)
+        self.sampleRate = try timer.configure(frequency: sampleRate)
+        self.longPress = UInt32(longPress * Double(self.sampleRate))
+    }
+
+    /// Adds the pins of `group` as inputs, with a pull-up for active-low
+    /// contacts and a pull-down otherwise, and returns the index reported in
+    /// their events. Must be called before `start`.
+    @discardableResult
+    public func watch(_ group: GPIO.PinGroup, activeLow: Bool = true) -> Int {
+        precondition(!timer.isRunning, "Debouncer.watch must be called before start")
+        group.configure(.input(pull: activeLow ? .up : .down))
+        ports.append(Port(group: group, activeLow: activeLow))
+        return ports.count - 1
+    }
+
+    public func start() throws {
+        try timer.start { [unowned self] in
+            self.scan()
+        }
+    }
+
+    public func stop() throws {
+        try timer.stop()
+    }
+
+    public func pop() -> Event? {
+        return events.pop()
+    }
+
+    /// Moves up to `buffer.count` events, oldest first, into `buffer` and
+    /// returns how many were moved.
+    public func read(into buffer: UnsafeMutableBufferPointer<Event>) -> Int {
+        return events.read(into: buffer)
+    }
+
+    /// Whether `pin` of the watched `group` is currently pressed.
+    public func isPressed(group: Int, pin: Int) -> Bool {
+        return ports[group].state & (1 << UInt16(pin)) != 0
+    }
+
+    private func scan() {
+        sample &+= 1
+        for (index, port) in ports.enumerated() {
+            var input = port.group.read()
+            if port.activeLow {
+                input = ~input & port.group.mask
+            }
+
+            // 2-bit vertical counters, reset on every sample equal to the
+            // debounced state; the pins whose counter rolls over toggle
+            let changed = port.state ^ input
+            port.count0 = ~(port.count0 & changed)
+            port.count1 = port.count0 ^ (port.count1 & changed)
+            let toggled = changed & port.count0 & port.count1
+            port.state ^= toggled
+
+            let pressed = toggled & port.state
+            let released = toggled & ~port.state
+            port.longReported &= ~released
+            emit(.pressed, pins: pressed, group: index) { pin in port.pressedAt[pin] = self.sample }
+            emit(.released, pins: released, group: index)
+
+            var held = port.state & ~port.longReported
+            while held != 0 {
+                let pin = 15 &- held.leadingZeroBitCount
+                held &= ~(1 << UInt16(pin))
+                if sample &- port.pressedAt[pin] >= longPress {
+                    port.longReported |= 1 << UInt16(pin)
+                    record(Event(kind: .longPressed, group: index, pin: pin, sample: sample))
+                }
+            }
+        }
+    }
+
+    private func emit(_ kind: Event.Kind, pins: UInt16, group: Int, _ each: (Int) -> Void = { _ in }) {
+        var pins = pins
+        while pins != 0 {
+            let pin = 15 &- pins.leadingZeroBitCount
+            pins &= ~(1 << UInt16(pin))
+            each(pin)
+            record(Event(kind: kind, group: group, pin: pin, sample: sample))
+        }
+    }
+
+    private func record(_ event: Event) {
+        if !events.push(event) {
+            dropped += 1
+        }
+    }
+}
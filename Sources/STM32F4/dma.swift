@@ -0,0 +1,287 @@
+import CSTM32F4
+
+public final class DMA {
+    public enum Direction {
+        case memoryToPeripheral
+        case peripheralToMemory
+        case memoryToMemory
+    }
+
+    public enum Mode {
+        case normal
+        case circular
+    }
+
+    public enum DataSize {
+        case byte
+        case halfWord
+        case word
+    }
+
+    public enum Priority {
+        case low
+        case medium
+        case high
+        case veryHigh
+    }
+
+    /// A peripheral DMA request, i.e. a (stream, channel) pair from the
+    /// request mapping tables of the reference manual (RM0090, tables 42/43).
+    public struct Request {
+        public let stream: Stream
+        public let channel: UInt32
+
+        public init(stream: Stream, channel: UInt32) {
+            self.stream = stream
+            self.channel = channel
+        }
+    }
+
+    public final class Stream {
+        @usableFromInline
+        let handle: UnsafeMutablePointer<DMA_HandleTypeDef>
+
+        let interruptNumber: IRQn_Type
+
+        fileprivate let enableClock: () -> Void
+
+        /// The driver the stream is configured for. Several requests map to
+        /// the same stream, so a driver claims it with `configure` and keeps
+        /// it until `release`; other drivers get `.busy` meanwhile.
+        private var owner: ObjectIdentifier?
+
+        fileprivate init(address: UInt32,
+                         interruptNumber: IRQn_Type,
+                         enableClock: @escaping @autoclosure () -> Void) {
+            handle = UnsafeMutablePointer<DMA_HandleTypeDef>.allocate(capacity: 1)
+            handle.initialize(to: DMA_HandleTypeDef())
+            handle.pointee.Instance = UnsafeMutablePointer<DMA_Stream_TypeDef>(bitPattern: UInt(address))!
+            self.interruptNumber = interruptNumber
+            self.enableClock = enableClock
+        }
+
+        /// Number of data items left to be transferred (the NDTR register).
+        @inlinable
+        public var remaining: Int {
+            return Int(handle.pointee.Instance.pointee.NDTR)
+        }
+
+        func configure(for owner: AnyObject,
+                       channel: UInt32,
+                       direction: Direction,
+                       mode: Mode = .normal,
+                       priority: Priority = .low,
+                       dataSize: DataSize = .byte) throws {
+            try criticalSection {
+                if let current = self.owner, current != ObjectIdentifier(owner) {
+                    throw STM32F4Error.busy
+                }
+                self.owner = ObjectIdentifier(owner)
+            }
+            enableClock()
+
+            var config = DMA_InitTypeDef()
+            config.Channel = channel
+            config.Direction = direction.hal
+            config.PeriphInc = DMA_PINC_DISABLE
+            config.MemInc = DMA_MINC_ENABLE
+            config.PeriphDataAlignment = dataSize.peripheralAlignment
+            config.MemDataAlignment = dataSize.memoryAlignment
+            config.Mode = mode.hal
+            config.Priority = priority.hal
+            config.FIFOMode = DMA_FIFOMODE_DISABLE
+            handle.pointee.Init = config
+
+            try HAL_DMA_DeInit(handle).throwOnFailure()
+            try HAL_DMA_Init(handle).throwOnFailure()
+
+            HAL_NVIC_SetPriority(interruptNumber, 3, 0)
+            HAL_NVIC_EnableIRQ(interruptNumber)
+        }
+
+        func link(to parent: UnsafeMutableRawPointer, for owner: AnyObject) {
+            precondition(isOwned(by: owner), "DMA stream linked before it was configured")
+            handle.pointee.Parent = parent
+        }
+
+        /// Gives up a stream claimed by `configure`, aborting a transfer
+        /// still running on it without calling its completion. Does nothing
+        /// if `owner` does not hold the stream.
+        func release(from owner: AnyObject) {
+            let owned: Bool = criticalSection {
+                guard isOwned(by: owner) else { return false }
+                self.owner = nil
+                completionHandler = nil
+                return true
+            }
+            if owned && HAL_DMA_GetState(handle) == HAL_DMA_STATE_BUSY {
+                HAL_DMA_Abort(handle)
+            }
+        }
+
+        private func isOwned(by owner: AnyObject) -> Bool {
+            return self.owner == ObjectIdentifier(owner)
+        }
+
+        /// Called from interrupt context once a transfer started with
+        /// `start` finishes, with `nil` on success.
+        public typealias CompletionHandler = (Error?) -> Void
+
+        private var completionHandler: CompletionHandler?
+
+        /// Starts a transfer that is not driven by a HAL peripheral driver,
+        /// e.g. one paced by a timer's DMA request. The stream must have
+        /// been configured for `owner` first, or this fails with `.busy`.
+        func start(for owner: AnyObject, from source: UnsafeRawPointer, to destination: UnsafeMutableRawPointer,
+                   count: Int, completion: @escaping CompletionHandler) throws {
+            guard isOwned(by: owner) else {
+                throw STM32F4Error.busy
+            }
+            handle.pointee.Parent = Unmanaged.passUnretained(self).toOpaque()
+            handle.pointee.XferCpltCallback = { hdma in
+                Unmanaged<Stream>.fromOpaque(hdma!.pointee.Parent).takeUnretainedValue().transferCompleted(error: nil)
+            }
+            handle.pointee.XferErrorCallback = { hdma in
+                Unmanaged<Stream>.fromOpaque(hdma!.pointee.Parent).takeUnretainedValue()
+                    .transferCompleted(error: STM32F4Error.unknownError)
+            }
+            completionHandler = completion
+            do {
+                try HAL_DMA_Start_IT(handle, UInt32(UInt(bitPattern: source)), UInt32(UInt(bitPattern: destination)),
+                                     UInt32(count)).throwOnFailure()
+            } catch {
+                completionHandler = nil
+                throw error
+            }
+        }
+
+        private func transferCompleted(error: Error?) {
+            let completion = completionHandler
+            completionHandler = nil
+            completion?(error)
+        }
+
+        @inlinable
+        func handleInterrupt() {
+            HAL_DMA_IRQHandler(handle)
+        }
+
+        public static let dma1Stream0 = Stream(address: DMA1_Stream0_BASE, interruptNumber: DMA1_Stream0_IRQn,
+                                               enableClock: m__HAL_RCC_DMA1_CLK_ENABLE())
+        public static let dma1Stream1 = Stream(address: DMA1_Stream1_BASE, interruptNumber: DMA1_Stream1_IRQn,
+                                               enableClock: m__HAL_RCC_DMA1_CLK_ENABLE())
+        public static let dma1Stream2 = Stream(address: DMA1_Stream2_BASE, interruptNumber: DMA1_Stream2_IRQn,
+                                               enableClock: m__HAL_RCC_DMA1_CLK_ENABLE())
+        public static let dma1Stream3 = Stream(address: DMA1_Stream3_BASE, interruptNumber: DMA1_Stream3_IRQn,
+                                               enableClock: m__HAL_RCC_DMA1_CLK_ENABLE())
+        public static let dma1Stream4 = Stream(address: DMA1_Stream4_BASE, interruptNumber: DMA1_Stream4_IRQn,
+                                               enableClock: m__HAL_RCC_DMA1_CLK_ENABLE())
+        public static let dma1Stream5 = Stream(address: DMA1_Stream5_BASE, interruptNumber: DMA1_Stream5_IRQn,
+                                               enableClock: m__HAL_RCC_DMA1_CLK_ENABLE())
+        public static let dma1Stream6 = Stream(address: DMA1_Stream6_BASE, interruptNumber: DMA1_Stream6_IRQn,
+                                               enableClock: m__HAL_RCC_DMA1_CLK_ENABLE())
+        public static let dma1Stream7 = Stream(address: DMA1_Stream7_BASE, interruptNumber: DMA1_Stream7_IRQn,
+                                               enableClock: m__HAL_RCC_DMA1_CLK_ENABLE())
+        public static let dma2Stream0 = Stream(address: DMA2_Stream0_BASE, interruptNumber: DMA2_Stream0_IRQn,
+                                               enableClock: m__HAL_RCC_DMA2_CLK_ENABLE())
+        public static let dma2Stream1 = Stream(address: DMA2_Stream1_BASE, interruptNumber: DMA2_Stream1_IRQn,
+                                               enableClock: m__HAL_RCC_DMA2_CLK_ENABLE())
+        public static let dma2Stream2 = Stream(address: DMA2_Stream2_BASE, interruptNumber: DMA2_Stream2_IRQn,
+                                               enableClock: m__HAL_RCC_DMA2_CLK_ENABLE())
+        public static let dma2Stream3 = Stream(address: DMA2_Stream3_BASE, interruptNumber: DMA2_Stream3_IRQn,
+                                               enableClock: m__HAL_RCC_DMA2_CLK_ENABLE())
+        public static let dma2Stream4 = Stream(address: DMA2_Stream4_BASE, interruptNumber: DMA2_Stream4_IRQn,
+                                               enableClock: m__HAL_RCC_DMA2_CLK_ENABLE())
+        public static let dma2Stream5 = Stream(address: DMA2_Stream5_BASE, interruptNumber: DMA2_Stream5_IRQn,
+                                               enableClock: m__HAL_RCC_DMA2_CLK_ENABLE())
+        public static let dma2Stream6 = Stream(address: DMA2_Stream6_BASE, interruptNumber: DMA2_Stream6_IRQn,
+                                               enableClock: m__HAL_RCC_DMA2_CLK_ENABLE())
+        public static let dma2Stream7 = Stream(address: DMA2_Stream7_BASE, interruptNumber: DMA2_Stream7_IRQn,
+                                               enableClock: m__HAL_RCC_DMA2_CLK_ENABLE())
+    }
+}
+
+// MARK: - Request mapping
+
+extension DMA.Request {
+    public static let usart1Rx = DMA.Request(stream: .dma2Stream2, channel: DMA_CHANNEL_4)
+    public static let usart1Tx = DMA.Request(stream: .dma2Stream7, channel: DMA_CHANNEL_4)
+    public static let usart2Rx = DMA.Request(stream: .dma1Stream5, channel: DMA_CHANNEL_4)
+    public static let usart2Tx = DMA.Request(stream: .dma1Stream6, channel: DMA_CHANNEL_4)
+    public static let usart3Rx = DMA.Request(stream: .dma1Stream1, channel: DMA_CHANNEL_4)
+    public static let usart3Tx = DMA.Request(stream: .dma1Stream3, channel: DMA_CHANNEL_4)
+    public static let uart4Rx = DMA.Request(stream: .dma1Stream2, channel: DMA_CHANNEL_4)
+    public static let uart4Tx = DMA.Request(stream: .dma1Stream4, channel: DMA_CHANNEL_4)
+    public static let uart5Rx = DMA.Request(stream: .dma1Stream0, channel: DMA_CHANNEL_4)
+    public static let uart5Tx = DMA.Request(stream: .dma1Stream7, channel: DMA_CHANNEL_4)
+    public static let usart6Rx = DMA.Request(stream: .dma2Stream1, channel: DMA_CHANNEL_5)
+    public static let usart6Tx = DMA.Request(stream: .dma2Stream6, channel: DMA_CHANNEL_5)
+
+    public static let i2c1Rx = DMA.Request(stream: .dma1Stream0, channel: DMA_CHANNEL_1)
+    public static let i2c1Tx = DMA.Request(stream: .dma1Stream6, channel: DMA_CHANNEL_1)
+    public static let i2c2Rx = DMA.Request(stream: .dma1Stream2, channel: DMA_CHANNEL_7)
+    public static let i2c2Tx = DMA.Request(stream: .dma1Stream7, channel: DMA_CHANNEL_7)
+    public static let i2c3Rx = DMA.Request(stream: .dma1Stream2, channel: DMA_CHANNEL_3)
+    public static let i2c3Tx = DMA.Request(stream: .dma1Stream4, channel: DMA_CHANNEL_3)
+    /// F446 mapping (RM0390), only on parts with an FMPI2C.
+    public static let fmpi2c1Rx = DMA.Request(stream: .dma1Stream3, channel: DMA_CHANNEL_2)
+    public static let fmpi2c1Tx = DMA.Request(stream: .dma1Stream1, channel: DMA_CHANNEL_2)
+
+    public static let spi1Rx = DMA.Request(stream: .dma2Stream0, channel: DMA_CHANNEL_3)
+    public static let spi1Tx = DMA.Request(stream: .dma2Stream3, channel: DMA_CHANNEL_3)
+    public static let spi2Rx = DMA.Request(stream: .dma1Stream3, channel: DMA_CHANNEL_0)
+    public static let spi2Tx = DMA.Request(stream: .dma1Stream4, channel: DMA_CHANNEL_0)
+    public static let spi3Rx = DMA.Request(stream: .dma1Stream0, channel: DMA_CHANNEL_0)
+    public static let spi3Tx = DMA.Request(stream: .dma1Stream5, channel: DMA_CHANNEL_0)
+
+    public static let tim1Up = DMA.Request(stream: .dma2Stream5, channel: DMA_CHANNEL_6)
+    public static let tim8Up = DMA.Request(stream: .dma2Stream1, channel: DMA_CHANNEL_7)
+}
+
+extension DMA.Direction {
+    var hal: UInt32 {
+        switch self {
+        case .memoryToPeripheral: return DMA_MEMORY_TO_PERIPH
+        case .peripheralToMemory: return DMA_PERIPH_TO_MEMORY
+        case .memoryToMemory: return DMA_MEMORY_TO_MEMORY
+        }
+    }
+}
+
+extension DMA.Mode {
+    var hal: UInt32 {
+        switch self {
+        case .normal: return DMA_NORMAL
+        case .circular: return DMA_CIRCULAR
+        }
+    }
+}
+
+extension DMA.DataSize {
+    var peripheralAlignment: UInt32 {
+        switch self {
+        case .byte: return DMA_PDATAALIGN_BYTE
+        case .halfWord: return DMA_PDATAALIGN_HALFWORD
+        case .word: return DMA_PDATAALIGN_WORD
+        }
+    }
+
+    var memoryAlignment: UInt32 {
+        switch self {
+        case .byte: return DMA_MDATAALIGN_BYTE
+        case .halfWord: return DMA_MDATAALIGN_HALFWORD
+        case .word: return DMA_MDATAALIGN_WORD
+        }
+    }
+}
+
+extension DMA.Priority {
+    var hal: UInt32 {
+        switch self {
+        case .low: return DMA_PRIORITY_LOW
+        case .medium: return DMA_PRIORITY_MEDIUM
+        case .high: return DMA_PRIORITY_HIGH
+        case .veryHigh: return DMA_PRIORITY_VERY_HIGH
+        }
+    }
+}
@@ -0,0 +1,55 @@
+import CSTM32F4
+import STM32F4Support
+
+extension GPIO {
+    /// An edge seen on a pin configured with `Pin.Mode.capture`.
+    public struct EdgeEvent {
+        /// The pin (and EXTI line) number.
+        public let pin: Int
+        /// The pin level when the interrupt was served, i.e. `.high` after
+        /// a rising edge unless the pin changed again since.
+        public let level: PinState
+        /// `CycleCounter.now` at interrupt entry. Edges served by the same
+        /// interrupt share a timestamp.
+        public let timestamp: UInt32
+    }
+
+    /// Collects timestamped edges from interrupt context for the application
+    /// to drain, so no user code runs in the interrupt. Several pins may
+    /// share a queue.
+    public final class EdgeQueue {
+        private let events: RingBuffer<EdgeEvent>
+
+        /// Number of edges lost because the queue was full. Written from
+        /// interrupt context only.
+        public private(set) var dropped = 0
+
+        public init(capacity: Int) {
+            events = RingBuffer<EdgeEvent>(capacity: capacity)
+        }
+
+        public var count: Int {
+            return events.count
+        }
+
+        public var isEmpty: Bool {
+            return events.isEmpty
+        }
+
+        public func pop() -> EdgeEvent? {
+            return events.pop()
+        }
+
+        /// Moves up to `buffer.count` edges, oldest first, into `buffer` and
+        /// returns how many were moved.
+        public func read(into buffer: UnsafeMutableBufferPointer<EdgeEvent>) -> Int {
+            return events.read(into: buffer)
+        }
+
+        func record(_ event: EdgeEvent) {
+            if !events.push(event) {
+                dropped += 1
+            }
+        }
+    }
+}
@@ -0,0 +1,378 @@
+import CSTM32F4
+import Hardware
+import STM32F4Support
+
+extension STM32F4 {
+    /// The Fast-mode Plus I2C peripheral of the F410, F412, F413/F423 and
+    /// F446. Configuring it fails on other parts.
+    public var fmpi2c: FMPI2C {
+        return getOrCreateResource(identifier: "fmpi2c_1",
+                                   create: FMPI2C(txDMA: .fmpi2c1Tx, rxDMA: .fmpi2c1Rx))
+    }
+}
+
+/// An I2C master on the FMPI2C peripheral, which reaches 1 MHz (Fast-mode
+/// Plus) and derives its bus timing from a single TIMINGR register.
+public final class FMPI2C {
+    public typealias CompletionHandler = I2C.CompletionHandler
+
+    let txDMA: DMA.Request
+    let rxDMA: DMA.Request
+
+    private var completionHandler: CompletionHandler?
+    private var dmaConfigured = false
+
+    /// The bus speed once configured.
+    private var speed: Int?
+    /// The TIMINGR value for `speed` at the current APB1 clock.
+    private var timing: UInt32 = 0
+
+    /// Set after a transfer ended without a STOP; the next transfer then
+    /// starts with a repeated START.
+    fileprivate var restartPending = false
+
+    /// Asynchronous transfers of at least this many bytes use DMA, shorter
+    /// ones are driven by the event interrupt.
+    public var dmaThreshold = 16
+
+    /// Whether the part has an FMPI2C peripheral.
+    public var isPresent: Bool {
+        return FMPI2C1_IsPresent()
+    }
+
+    fileprivate init(txDMA: DMA.Request, rxDMA: DMA.Request) {
+        self.txDMA = txDMA
+        self.rxDMA = rxDMA
+        instance = self
+        Clock.observers.append(self)
+    }
+
+    /// Configures the peripheral for `speed` Hz, up to 1 MHz. The timing is
+    /// computed from the current APB1 clock, and again when
+    /// `STM32F4.setClock` changes it; a speed the APB1 clock cannot produce
+    /// throws, and so does a later clock tree that cannot.
+    public func configure(speed: Int, clockPin: GPIO.Pin, dataPin: GPIO.Pin) throws {
+        guard isPresent else {
+            throw STM32F4Error.unknownError
+        }
+        guard let timing = FMPI2C.timing(speed: speed, clockFrequency: Int(FMPI2C1_GetClockFrequency())) else {
+            throw STM32F4Error.unknownError
+        }
+        connect(clockPin, as: .i2cSCL)
+        connect(dataPin, as: .i2cSDA)
+        try FMPI2C1_Init(timing, speed > 400_000).throwOnFailure()
+        self.speed = speed
+        self.timing = timing
+        txDMA.stream.release(from: self)
+        rxDMA.stream.release(from: self)
+        dmaConfigured = false
+        restartPending = false
+    }
+
+    /// Reinitializes the peripheral with the kept timing. Clearing PE
+    /// abandons a transfer in progress and releases SCL and SDA.
+    private func reset() {
+        guard let speed = speed else { return }
+        criticalSection {
+            _ = FMPI2C1_Init(timing, speed > 400_000)
+        }
+        restartPending = false
+    }
+
+    private func connect(_ pin: GPIO.Pin, as signal: PinMux.Signal) {
+        let pinConfig = GPIO_InitTypeDef(Pin: 0, Mode: UInt32(GPIO_MODE_AF_OD),
+                                         Pull: GPIO_PULLUP, Speed: GPIO_SPEED_FREQ_VERY_HIGH,
+                                         Alternate: PinMux.alternate(for: pin, instance: PinMux.fmpi2c1,
+                                                                     signal: signal))
+        pin.configure(.manual(hal: pinConfig))
+    }
+
+    /// `true` while a transfer is in progress.
+    public var isBusy: Bool {
+        return FMPI2C1_IsBusy()
+    }
+
+    // MARK: Asynchronous transfers
+    //
+    // The buffers must stay valid until `completion` is called. A transfer
+    // fails with `.busy` while another one is in progress.
+
+    public func writeAsync(address: Int, _ buffer: UnsafeBufferPointer<UInt8>, stop: Bool = true,
+                           completion: @escaping CompletionHandler) throws {
+        let first = !restartPending
+        try startAsync(byteCount: buffer.count, stop: stop, completion,
+                       interrupt: {
+                           FMPI2C1_Transmit_IT(UInt16(address) << 1, buffer.baseAddress, UInt16(buffer.count),
+                                               first, stop)
+                       },
+                       dma: {
+                           FMPI2C1_Transmit_DMA(UInt16(address) << 1, buffer.baseAddress, UInt16(buffer.count))
+                       })
+    }
+
+    public func readAsync(address: Int, into buffer: UnsafeMutableBufferPointer<UInt8>, stop: Bool = true,
+                          completion: @escaping CompletionHandler) throws {
+        let first = !restartPending
+        try startAsync(byteCount: buffer.count, stop: stop, completion,
+                       interrupt: {
+                           FMPI2C1_Receive_IT(UInt16(address) << 1, buffer.baseAddress, UInt16(buffer.count),
+                                              first, stop)
+                       },
+                       dma: {
+                           FMPI2C1_Receive_DMA(UInt16(address) << 1, buffer.baseAddress, UInt16(buffer.count))
+                       })
+    }
+
+    private func startAsync(byteCount: Int,
+                            stop: Bool,
+                            _ completion: @escaping CompletionHandler,
+                            interrupt: () -> HAL_StatusTypeDef,
+                            dma: () -> HAL_StatusTypeDef) throws {
+        // the DMA path always starts and ends the bus transaction
+        let useDMA = stop && !restartPending && byteCount >= dmaThreshold
+        // the running transfer owns the completion handler and the streams
+        try criticalSection {
+            guard !isBusy else {
+                throw STM32F4Error.busy
+            }
+            if useDMA {
+                try configureDMA()
+            }
+            completionHandler = completion
+            do {
+                try (useDMA ? dma() : interrupt()).throwOnFailure()
+                restartPending = !stop
+            } catch {
+                completionHandler = nil
+                throw error
+            }
+        }
+    }
+
+    /// Runs an interrupt-driven transfer and waits for it to finish.
+    private func transferBlocking(stop: Bool, timeout: UInt32, _ start: (_ first: Bool) -> HAL_StatusTypeDef) throws {
+        try start(!restartPending).throwOnFailure()
+        restartPending = !stop
+        let startTick = HAL_GetTick()
+        while FMPI2C1_IsBusy() {
+            if HAL_GetTick() &- startTick > timeout {
+                // the HAL would stay BUSY and refuse every later transfer
+                reset()
+                throw STM32F4Error.timeout
+            }
+        }
+        do {
+            try FMPI2C1_GetStatus().throwOnFailure()
+        } catch {
+            restartPending = false
+            throw error
+        }
+    }
+
+    private func configureDMA() throws {
+        guard !dmaConfigured else { return }
+        // a stream claimed alone would be held for nothing
+        do {
+            try txDMA.stream.configure(for: self, channel: txDMA.channel, direction: .memoryToPeripheral,
+                                       priority: .medium)
+            try rxDMA.stream.configure(for: self, channel: rxDMA.channel, direction: .peripheralToMemory,
+                                       priority: .high)
+        } catch {
+            txDMA.stream.release(from: self)
+            rxDMA.stream.release(from: self)
+            throw error
+        }
+        FMPI2C1_LinkDMA(txDMA.stream.handle, rxDMA.stream.handle)
+        dmaConfigured = true
+    }
+
+    fileprivate func transferCompleted(error: Error?) {
+        let completion = completionHandler
+        completionHandler = nil
+        completion?(error)
+    }
+}
+
+private var instance: FMPI2C?
+
+// MARK: - Timing
+
+extension FMPI2C {
+    /// Bus characteristics from the I2C specification, in nanoseconds.
+    private struct BusTiming {
+        var lowMin: Int64
+        var highMin: Int64
+        var dataSetupMin: Int64
+        var riseMax: Int64
+        var fallMax: Int64
+
+        init(speed: Int) {
+            switch speed {
+            case ...100_000:
+                (lowMin, highMin, dataSetupMin, riseMax, fallMax) = (4700, 4000, 250, 1000, 300)
+            case ...400_000:
+                (lowMin, highMin, dataSetupMin, riseMax, fallMax) = (1300, 600, 100, 300, 300)
+            default:
+                (lowMin, highMin, dataSetupMin, riseMax, fallMax) = (500, 260, 50, 120, 120)
+            }
+        }
+    }
+
+    /// Computes the TIMINGR value for `speed` Hz from the kernel clock, or
+    /// `nil` if the resulting clock would be more than 10% too slow. The
+    /// smallest prescaler that fits is used; the SCL period is shortened by
+    /// the synchronization delays (analog filter and 3 kernel clocks per
+    /// edge) and split between low and high in the ratio of their minimums.
+    static func timing(speed: Int, clockFrequency: Int) -> UInt32? {
+        precondition(speed > 0 && speed <= 1_000_000, "invalid FMPI2C speed")
+        guard clockFrequency > 0 else { return nil }
+        let bus = BusTiming(speed: speed)
+        // all durations in picoseconds, which keeps the rounding error well
+        // below one kernel clock
+        let analogFilterDelay: Int64 = 50_000
+        let clockPeriod = 1_000_000_000_000 / Int64(clockFrequency)
+        let sync = 2 * analogFilterDelay + 6 * clockPeriod
+        let sclPeriod = 1_000_000_000_000 / Int64(speed) - sync
+
+        func ticks(_ duration: Int64, _ tick: Int64) -> Int64 {
+            return (duration + tick - 1) / tick
+        }
+
+        for prescaler in Int64(0)..<16 {
+            let tick = clockPeriod * (prescaler + 1)
+            let dataSetup = max(ticks((bus.riseMax + bus.dataSetupMin) * 1000, tick) - 1, 0)
+            let dataHold = ticks(max(bus.fallMax * 1000 - analogFilterDelay - 3 * clockPeriod, 0), tick)
+            guard dataSetup <= 15, dataHold <= 15 else { continue }
+
+            let period = ticks(sclPeriod, tick)
+            guard period * tick * 10 <= sclPeriod * 11 else { continue }
+            let lowMin = ticks(bus.lowMin * 1000, tick)
+            let highMin = ticks(bus.highMin * 1000, tick)
+            guard period >= lowMin + highMin else { continue }
+            var low = max(lowMin, period * bus.lowMin / (bus.lowMin + bus.highMin))
+            var high = period - low
+            if high < highMin {
+                high = highMin
+                low = period - high
+            }
+            guard low <= 256, high <= 256 else { continue }
+
+            return UInt32(prescaler) << 28
+                | UInt32(dataSetup) << 20
+                | UInt32(dataHold) << 16
+                | UInt32(high - 1) << 8
+                | UInt32(low - 1)
+        }
+        return nil
+    }
+}
+
+// MARK: - Hardware.I2C
+
+extension FMPI2C: ClockObserver {
+    /// Refuses a tree whose APB1 clock cannot produce the configured speed.
+    public func clockWillChange(to tree: ClockTree) throws {
+        guard let speed = speed else { return }
+        guard FMPI2C.timing(speed: speed, clockFrequency: tree.pclk1) != nil else {
+            throw STM32F4Error.unknownError
+        }
+        let start = HAL_GetTick()
+        while isBusy {
+            if HAL_GetTick() &- start > 1000 {
+                throw STM32F4Error.timeout
+            }
+        }
+    }
+
+    public func clockDidChange(to tree: ClockTree) {
+        guard let speed = speed,
+              let timing = FMPI2C.timing(speed: speed, clockFrequency: Int(FMPI2C1_GetClockFrequency())) else {
+            return
+        }
+        self.timing = timing
+        reset()
+    }
+}
+
+extension FMPI2C: Hardware.I2C {
+    public func read(address: Int, into buffer: UnsafeMutableBufferPointer<UInt8>, stop: Bool, timeout: TimeInterval) throws {
+        guard stop && !restartPending else {
+            return try transferBlocking(stop: stop, timeout: UInt32(timeout)) { first in
+                FMPI2C1_Receive_IT(UInt16(address) << 1, buffer.baseAddress, UInt16(buffer.count), first, stop)
+            }
+        }
+        try FMPI2C1_Receive(UInt16(address) << 1, buffer.baseAddress, UInt16(buffer.count),
+                            UInt32(timeout)).throwOnFailure()
+    }
+
+    public func write(address: Int, buffer: UnsafeBufferPointer<UInt8>, stop: Bool, timeout: TimeInterval) throws {
+        guard stop && !restartPending else {
+            return try transferBlocking(stop: stop, timeout: UInt32(timeout)) { first in
+                FMPI2C1_Transmit_IT(UInt16(address) << 1, buffer.baseAddress, UInt16(buffer.count), first, stop)
+            }
+        }
+        try FMPI2C1_Transmit(UInt16(address) << 1, buffer.baseAddress, UInt16(buffer.count),
+                             UInt32(timeout)).throwOnFailure()
+    }
+}
+
+// MARK: - Memory access
+
+extension FMPI2C {
+    public func readMemory(address: Int, memoryAddress: Int, addressSize: I2C.MemoryAddressSize,
+                           into buffer: UnsafeMutableBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        try FMPI2C1_MemRead(UInt16(address) << 1, UInt16(truncatingIfNeeded: memoryAddress),
+                            addressSize.byteCount, buffer.baseAddress,
+                            UInt16(buffer.count), UInt32(timeout)).throwOnFailure()
+    }
+
+    public func writeMemory(address: Int, memoryAddress: Int, addressSize: I2C.MemoryAddressSize,
+                            buffer: UnsafeBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        try FMPI2C1_MemWrite(UInt16(address) << 1, UInt16(truncatingIfNeeded: memoryAddress),
+                             addressSize.byteCount, buffer.baseAddress,
+                             UInt16(buffer.count), UInt32(timeout)).throwOnFailure()
+    }
+
+    /// Polls the device until it acknowledges its address.
+    public func waitUntilReady(address: Int, timeout: TimeInterval) throws {
+        let start = HAL_GetTick()
+        while FMPI2C1_IsDeviceReady(UInt16(address) << 1, 1, UInt32(timeout)) != HAL_OK {
+            if HAL_GetTick() &- start > UInt32(timeout) {
+                throw STM32F4Error.timeout
+            }
+        }
+    }
+}
+
+extension FMPI2C: Hardware.I2CMemory {
+    public func read(address: Int, register: UInt8, into buffer: UnsafeMutableBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        try readMemory(address: address, memoryAddress: Int(register), addressSize: .eightBits,
+                       into: buffer, timeout: timeout)
+    }
+
+    public func write(address: Int, register: UInt8, buffer: UnsafeBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        try writeMemory(address: address, memoryAddress: Int(register), addressSize: .eightBits,
+                        buffer: buffer, timeout: timeout)
+    }
+}
+
+extension I2C.MemoryAddressSize {
+    var byteCount: UInt16 {
+        switch self {
+        case .eightBits: return 1
+        case .sixteenBits: return 2
+        }
+    }
+}
+
+@_silgen_name("FMPI2C1_TransferCompleted")
+internal func FMPI2C1_TransferCompleted(status: HAL_StatusTypeDef) {
+    guard let fmpi2c = instance else { return }
+    do {
+        try status.throwOnFailure()
+        fmpi2c.transferCompleted(error: nil)
+    } catch {
+        fmpi2c.restartPending = false
+        fmpi2c.transferCompleted(error: error)
+    }
+}
@@ -9,6 +9,9 @@ extension STM32F4 {
 
 public final class GPIO {
     public typealias InterruptHandler = () -> Void
+    /// An EXTI handler without a closure context, called directly from the
+    /// interrupt with the pointer it was registered with.
+    public typealias RawInterruptHandler = @convention(c) (UnsafeMutableRawPointer?) -> Void
 
     public func pin(peripheral: Peripheral, number: Int, mode: Pin.Mode? = nil) -> Pin {
         return peripheral.pin(number: number, mode: mode)
@@ -36,6 +39,11 @@ public final class GPIO {
             case input(pull: Pull)
             case output
             case interrupt(edge: Edge, pull: Pull, handler: InterruptHandler)
+            /// Calls `handler` with `context` on each edge.
+            case rawInterrupt(edge: Edge, pull: Pull, handler: RawInterruptHandler, context: UnsafeMutableRawPointer?)
+            /// Records each edge with a cycle-count timestamp into `queue`
+            /// instead of running a handler.
+            case capture(edge: Edge, pull: Pull, queue: EdgeQueue)
             case manual(hal: GPIO_InitTypeDef)
         }
 
@@ -60,38 +68,92 @@ public final class GPIO {
             // start the peripheral's clock
             peripheral.enableClock()
             // prepare the init struct
-            var config: GPIO_InitTypeDef
+            var config = mode.initStruct(pins: numberHal)
             switch mode {
-            case let .input(pull):
-                config = GPIO_InitTypeDef(
-                    Pin: numberHal, Mode: UInt32(GPIO_MODE_INPUT),
-                    Pull: pull.hal, Speed: GPIO_SPEED_FREQ_LOW,
-                    Alternate: 0
-                )
-            case .output:
-                config = GPIO_InitTypeDef(
-                    Pin: numberHal, Mode: UInt32(GPIO_MODE_OUTPUT_PP),
-                    Pull: GPIO_NOPULL, Speed: GPIO_SPEED_FREQ_VERY_HIGH,
-                    Alternate: 0
-                )
-            case let .interrupt(edge, pull, handler):
-                config = GPIO_InitTypeDef(
-                    Pin: numberHal, Mode: edge.rawValue,
-                    Pull: pull.hal, Speed: GPIO_SPEED_FREQ_VERY_HIGH,
-                    Alternate: 0
-                )
-                interruptHandlers[self.number] = handler
+            case let .interrupt(_, _, handler):
+                setHandler(handler)
                 HAL_NVIC_SetPriority(interruptNumber, 3, 0)
                 HAL_NVIC_EnableIRQ(interruptNumber)
-            case let .manual(hal):
-                config = hal
-                config.Pin = numberHal
+            case let .rawInterrupt(_, _, handler, context):
+                setHandler(handler, context: context)
+                HAL_NVIC_SetPriority(interruptNumber, 3, 0)
+                HAL_NVIC_EnableIRQ(interruptNumber)
+            case let .capture(_, _, queue):
+                CycleCounter.enable()
+                setCapture(queue)
+                HAL_NVIC_SetPriority(interruptNumber, 3, 0)
+                HAL_NVIC_EnableIRQ(interruptNumber)
+            default:
+                break
             }
             // init the pin
             HAL_GPIO_Init(peripheral.ptr, &config)
             self.mode = mode
         }
 
+        /// Routes the pin to its EXTI line without changing its mode, so that
+        /// edges on a pin driven by a peripheral (e.g. a hardware NSS input)
+        /// can be observed.
+        public func attachInterrupt(edge: Edge, handler: @escaping InterruptHandler) {
+            setHandler(handler)
+            routeToEXTI(edge: edge)
+        }
+
+        public func attachInterrupt(edge: Edge, handler: RawInterruptHandler, context: UnsafeMutableRawPointer?) {
+            setHandler(handler, context: context)
+            routeToEXTI(edge: edge)
+        }
+
+        private func routeToEXTI(edge: Edge) {
+            let shift = 2 * UInt32(number)
+            // HAL_GPIO_Init leaves AFR, speed and output type alone for a
+            // combined EXTI mode, only MODER and PUPDR are rewritten
+            let moder = (peripheral.ptr.pointee.MODER >> shift) & 0x3
+            let pull = (peripheral.ptr.pointee.PUPDR >> shift) & 0x3
+            var config = GPIO_InitTypeDef(
+                Pin: numberHal, Mode: edge.rawValue | moder,
+                Pull: pull, Speed: GPIO_SPEED_FREQ_VERY_HIGH,
+                Alternate: 0
+            )
+            HAL_GPIO_Init(peripheral.ptr, &config)
+            HAL_NVIC_SetPriority(interruptNumber, 3, 0)
+            HAL_NVIC_EnableIRQ(interruptNumber)
+        }
+
+        /// Stores the handler of the pin's EXTI line. The slot is swapped
+        /// with interrupts masked, so the interrupt never sees a function
+        /// with another one's context.
+        private func setHandler(_ function: RawInterruptHandler?, context: UnsafeMutableRawPointer?,
+                                owner: AnyObject? = nil) {
+            criticalSection {
+                EXTI_GetSlot(UInt32(number)).pointee = EXTI_Slot(function: function, context: context,
+                                                                  capturePort: nil)
+                slotOwners[number] = owner
+            }
+        }
+
+        /// Points the pin's EXTI line at `queue`, which the slot holds
+        /// unretained and `slotOwners` keeps alive.
+        private func setCapture(_ queue: EdgeQueue) {
+            criticalSection {
+                EXTI_GetSlot(UInt32(number)).pointee = EXTI_Slot(function: nil,
+                                                                  context: Unmanaged.passUnretained(queue).toOpaque(),
+                                                                  capturePort: peripheral.ptr)
+                slotOwners[number] = queue
+            }
+        }
+
+        /// Adapts a closure to the raw table: the closure is boxed, the box
+        /// is kept alive in `slotOwners` and passed as the context.
+        private func setHandler(_ handler: @escaping InterruptHandler) {
+            let closure = ClosureHandler(handler)
+            setHandler({ context in
+                           Unmanaged<ClosureHandler>.fromOpaque(context!)._withUnsafeGuaranteedRef { $0.handler() }
+                       },
+                       context: Unmanaged.passUnretained(closure).toOpaque(),
+                       owner: closure)
+        }
+
         public func unconfigure() {
             HAL_GPIO_DeInit(peripheral.ptr, numberHal)
             mode = nil
@@ -117,7 +179,7 @@ public final class GPIO {
 
         private var pins: [Pin?] = [Pin?](repeating: nil, count: 16)
 
-        fileprivate let enableClock: () -> Void
+        let enableClock: () -> Void
 
         fileprivate init(address: UInt32, enableClock: @escaping @autoclosure () -> Void) {
             ptr = UnsafeMutablePointer<GPIO_TypeDef>(bitPattern: UInt(address))!
@@ -181,22 +243,50 @@ extension GPIO.Pin: ToggleableDigitalOut {
     }
 }
 
-private var interruptHandlers = [GPIO.InterruptHandler?](repeating: nil, count: 16)
+/// Owns a closure registered as an EXTI handler.
+private final class ClosureHandler {
+    let handler: GPIO.InterruptHandler
 
-private func pinNumberHalToPinNumber(_ numberHal: UInt16) -> Int {
-    var numberHal: UInt16 = numberHal
-    var number: Int = 0
-    while numberHal != 1 {
-        numberHal = numberHal >> 1
-        number += 1
+    init(_ handler: @escaping GPIO.InterruptHandler) {
+        self.handler = handler
     }
-    return number
 }
 
-@_silgen_name("HAL_GPIO_EXTI_Callback")
-internal func HAL_GPIO_EXTI_Callback(pinNumberHal: UInt16) {
-    let pinNumber = pinNumberHalToPinNumber(pinNumberHal)
-    interruptHandlers[pinNumber]?()
+/// The handlers themselves live in `EXTI_Slots`, a C array in .bss, so
+/// dispatch needs no lazy initializer, bounds or uniqueness check, and
+/// calls a C function pointer with no retain or release. These are the
+/// boxed closures and queues behind the slots, never read from the
+/// interrupt.
+private let slotOwners: UnsafeMutablePointer<AnyObject?> = {
+    let table = UnsafeMutablePointer<AnyObject?>.allocate(capacity: 16)
+    table.initialize(repeating: nil, count: 16)
+    return table
+}()
+
+extension GPIO {
+    /// Serves the pending EXTI lines among `lines`. The pending register is
+    /// read and cleared once, then the handlers of the set bits are called,
+    /// highest line first, each found with a single CLZ.
+    static func handleInterrupt(lines: UInt32) {
+        let timestamp = CycleCounter.now
+        let exti = UnsafeMutablePointer<EXTI_TypeDef>(bitPattern: UInt(EXTI_BASE))!
+        var pending = exti.pointee.PR & exti.pointee.IMR & lines
+        // write 1 to clear, before the handlers so no new edge is lost
+        exti.pointee.PR = pending
+        while pending != 0 {
+            let line = 31 &- pending.leadingZeroBitCount
+            pending &= ~(1 << UInt32(line))
+            let slot = EXTI_GetSlot(UInt32(line)).pointee
+            if let port = slot.capturePort {
+                let level: PinState = port.pointee.IDR & (1 << UInt32(line)) != 0 ? .high : .low
+                Unmanaged<EdgeQueue>.fromOpaque(slot.context)._withUnsafeGuaranteedRef { queue in
+                    queue.record(EdgeEvent(pin: line, level: level, timestamp: timestamp))
+                }
+            } else {
+                slot.function?(slot.context)
+            }
+        }
+    }
 }
 
 extension PinState {
@@ -215,6 +305,34 @@ extension PinState {
     }
 }
 
+extension GPIO.Pin.Mode {
+    func initStruct(pins: UInt32) -> GPIO_InitTypeDef {
+        switch self {
+        case let .input(pull):
+            return GPIO_InitTypeDef(
+                Pin: pins, Mode: UInt32(GPIO_MODE_INPUT),
+                Pull: pull.hal, Speed: GPIO_SPEED_FREQ_LOW,
+                Alternate: 0
+            )
+        case .output:
+            return GPIO_InitTypeDef(
+                Pin: pins, Mode: UInt32(GPIO_MODE_OUTPUT_PP),
+                Pull: GPIO_NOPULL, Speed: GPIO_SPEED_FREQ_VERY_HIGH,
+                Alternate: 0
+            )
+        case let .interrupt(edge, pull, _), let .rawInterrupt(edge, pull, _, _), let .capture(edge, pull, _):
+            return GPIO_InitTypeDef(
+                Pin: pins, Mode: edge.rawValue,
+                Pull: pull.hal, Speed: GPIO_SPEED_FREQ_VERY_HIGH,
+                Alternate: 0
+            )
+        case var .manual(hal):
+            hal.Pin = pins
+            return hal
+        }
+    }
+}
+
 extension GPIO.Pin.Pull {
     fileprivate var hal: UInt32 {
         switch self {
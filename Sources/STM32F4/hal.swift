@@ -1,6 +1,7 @@
 import CSTM32F4
 import Hardware
 import Glibc
+@_exported import STM32F4Support
 
 public enum STM32F4Error: Error {
     case unknownError
@@ -21,17 +22,28 @@ public class STM32F4 {
         }
     }
 
-    public init() throws {
-        try Clock.setup()
+    /// Sets up `clock`, 168 MHz from the 8 MHz ST-LINK clock by default,
+    /// and initializes the HAL.
+    public init(clock: ClockTree = .discovery) throws {
+        try Clock.setup(clock)
+        MonotonicClock.start(frequency: Clock.tree.hclk)
         try HAL_Init().throwOnFailure()
     }
 
-    public var systemClockFrequency: Int { Int(HAL_RCC_GetSysClockFreq()) }
+    public var systemClockFrequency: Int { Clock.tree.sysclk }
+
+    public var clockTree: ClockTree { Clock.tree }
 
     public var tick: UInt32 { HAL_GetTick() }
 
+    /// Waits for `interval` milliseconds, in low-power idle once `idle` is
+    /// configured and busy otherwise.
     public func sleep(_ interval: TimeInterval) {
-        HAL_Delay(UInt32(interval))
+        if let idle = resources["idle"] as? TicklessIdle, idle.isConfigured {
+            idle.sleep(milliseconds: UInt32(interval))
+        } else {
+            HAL_Delay(UInt32(interval))
+        }
     }
 
     deinit {
@@ -68,11 +80,21 @@ func _sleep_ms(ms: UInt32) {
     HAL_Delay(ms)
 }
 
+/// Time since startup from `MonotonicClock`, to the microsecond.
 @_silgen_name("_gettimeofday")
 func getTimeOfDay(tv: UnsafeMutablePointer<timeval>) -> Int {
-    let ticks = HAL_GetTick()
-    tv.pointee.tv_sec = time_t(ticks / 1000)
-    tv.pointee.tv_usec = suseconds_t((ticks % 1000) * 1000)
+    let microseconds = MonotonicClock.microseconds
+    tv.pointee.tv_sec = time_t(microseconds / 1_000_000)
+    tv.pointee.tv_usec = suseconds_t(microseconds % 1_000_000)
+    return 0
+}
+
+/// Both the realtime and the monotonic clock count from startup.
+@_silgen_name("clock_gettime")
+func clockGetTime(clock: clockid_t, tp: UnsafeMutablePointer<timespec>) -> Int {
+    let nanoseconds = MonotonicClock.nanoseconds
+    tp.pointee.tv_sec = time_t(nanoseconds / 1_000_000_000)
+    tp.pointee.tv_nsec = Int(nanoseconds % 1_000_000_000)
     return 0
 }
 
@@ -1,17 +1,36 @@
 import CSTM32F4
 import Hardware
+import STM32F4Support
 
 extension STM32F4 {
     public var i2c: I2C {
         return getOrCreateResource(identifier: "i2c_1",
                                    create: I2C(address: I2C1_BASE,
-                                               enableClock: m__HAL_RCC_I2C1_CLK_ENABLE))
+                                               enableClock: m__HAL_RCC_I2C1_CLK_ENABLE,
+                                               eventInterruptNumber: I2C1_EV_IRQn,
+                                               errorInterruptNumber: I2C1_ER_IRQn,
+                                               txDMA: .i2c1Tx,
+                                               rxDMA: .i2c1Rx))
     }
 
     public var i2c_2: I2C {
         return getOrCreateResource(identifier: "i2c_2",
                                    create: I2C(address: I2C2_BASE,
-                                               enableClock: m__HAL_RCC_I2C2_CLK_ENABLE))
+                                               enableClock: m__HAL_RCC_I2C2_CLK_ENABLE,
+                                               eventInterruptNumber: I2C2_EV_IRQn,
+                                               errorInterruptNumber: I2C2_ER_IRQn,
+                                               txDMA: .i2c2Tx,
+                                               rxDMA: .i2c2Rx))
+    }
+
+    public var i2c_3: I2C {
+        return getOrCreateResource(identifier: "i2c_3",
+                                   create: I2C(address: I2C3_BASE,
+                                               enableClock: m__HAL_RCC_I2C3_CLK_ENABLE,
+                                               eventInterruptNumber: I2C3_EV_IRQn,
+                                               errorInterruptNumber: I2C3_ER_IRQn,
+                                               txDMA: .i2c3Tx,
+                                               rxDMA: .i2c3Rx))
     }
 }
 
@@ -19,28 +38,83 @@ public final class I2C {
     @usableFromInline
     var handle: UnsafeMutablePointer<I2C_HandleTypeDef>
 
+    let address: UInt32
     let enableClock: () -> Void
+    let eventInterruptNumber: IRQn_Type
+    let errorInterruptNumber: IRQn_Type
+    let txDMA: DMA.Request
+    let rxDMA: DMA.Request
 
     var timeoutMs = 1000
 
-    fileprivate init(address: UInt32, enableClock: @escaping () -> Void) {
+    /// Called from interrupt context once an asynchronous transfer finishes,
+    /// with `nil` on success.
+    public typealias CompletionHandler = (Error?) -> Void
+
+    private var completionHandler: CompletionHandler?
+    private var dmaConfigured = false
+
+    /// Set after a transfer ended without a STOP; the next transfer then
+    /// starts with a repeated START.
+    fileprivate var restartPending = false
+
+    let transactionQueue = RingBuffer<Transaction>(capacity: 16)
+    /// Set while a queued transaction or a write-read pair owns the bus,
+    /// including between its transfers, when the HAL is idle but the bus
+    /// has not been released. Direct transfers fail with `.busy` meanwhile.
+    var transactionActive = false
+
+    /// Asynchronous transfers of at least this many bytes use DMA, shorter
+    /// ones are driven by the event interrupt.
+    public var dmaThreshold = 16
+
+    private var clockPin: GPIO.Pin?
+    private var dataPin: GPIO.Pin?
+
+    /// Number of times a bus held by a slave has been recovered.
+    public private(set) var busRecoveries = 0
+
+    /// Set while answering a host as a slave.
+    var registerMap: RegisterMap?
+
+    fileprivate init(address: UInt32,
+                     enableClock: @escaping () -> Void,
+                     eventInterruptNumber: IRQn_Type,
+                     errorInterruptNumber: IRQn_Type,
+                     txDMA: DMA.Request,
+                     rxDMA: DMA.Request) {
         handle = UnsafeMutablePointer<I2C_HandleTypeDef>.allocate(capacity: 1)
-        handle.initialize(repeating: I2C_HandleTypeDef(), count: 0)
+        handle.initialize(repeating: I2C_HandleTypeDef(), count: 1)
         handle.pointee.Instance = UnsafeMutablePointer<I2C_TypeDef>(bitPattern: UInt(address))!
+        self.address = address
         self.enableClock = enableClock
+        self.eventInterruptNumber = eventInterruptNumber
+        self.errorInterruptNumber = errorInterruptNumber
+        self.txDMA = txDMA
+        self.rxDMA = rxDMA
+        instances.append(self)
+        Clock.observers.append(self)
     }
 
     deinit {
+        txDMA.stream.release(from: self)
+        rxDMA.stream.release(from: self)
         self.handle.deallocate()
     }
 
-    public func configure(speed: Int, clockPin: GPIO.Pin, dataPin: GPIO.Pin) throws {
-        // connect pins
+    private func connect(_ pin: GPIO.Pin, as signal: PinMux.Signal) {
         let pinConfig = GPIO_InitTypeDef(Pin: 0, Mode: UInt32(GPIO_MODE_AF_OD),
                                          Pull: GPIO_PULLUP, Speed: GPIO_SPEED_FREQ_HIGH,
-                                         Alternate: UInt32(GPIO_AF4_I2C1))
-        clockPin.configure(.manual(hal: pinConfig))
-        dataPin.configure(.manual(hal: pinConfig))
+                                         Alternate: PinMux.alternate(for: pin, instance: address, signal: signal))
+        pin.configure(.manual(hal: pinConfig))
+    }
+
+    public func configure(speed: Int, clockPin: GPIO.Pin, dataPin: GPIO.Pin) throws {
+        // connect pins
+        connect(clockPin, as: .i2cSCL)
+        connect(dataPin, as: .i2cSDA)
+        self.clockPin = clockPin
+        self.dataPin = dataPin
         enableClock()
         // init i2c component
         var initInfo = I2C_InitTypeDef()
@@ -52,39 +126,571 @@ public final class I2C {
         initInfo.NoStretchMode = I2C_NOSTRETCH_DISABLE
         handle.pointee.Init = initInfo
         try HAL_I2C_Init(handle).throwOnFailure()
+        txDMA.stream.release(from: self)
+        rxDMA.stream.release(from: self)
+        dmaConfigured = false
+        restartPending = false
+        registerMap = nil
+
+        HAL_NVIC_SetPriority(eventInterruptNumber, 3, 0)
+        HAL_NVIC_EnableIRQ(eventInterruptNumber)
+        HAL_NVIC_SetPriority(errorInterruptNumber, 3, 0)
+        HAL_NVIC_EnableIRQ(errorInterruptNumber)
+    }
+
+    /// `true` while an asynchronous transfer is in progress.
+    public var isBusy: Bool {
+        return HAL_I2C_GetState(handle) != HAL_I2C_STATE_READY
+    }
+
+    /// `true` when the bus is busy although no transfer of ours is running,
+    /// i.e. a slave holds SDA low.
+    private var busStuck: Bool {
+        return HAL_I2C_GetState(handle) == HAL_I2C_STATE_READY
+            && handle.pointee.Instance.pointee.SR2 & I2C_SR2_BUSY != 0
+    }
+
+    /// Frees a bus held by a slave, following the BUSY-flag erratum: SCL is
+    /// clocked by hand until the slave releases SDA, a STOP is generated
+    /// and the peripheral is reset and reinitialized.
+    public func recoverBus() throws {
+        guard let clockPin = clockPin, let dataPin = dataPin else { return }
+        busRecoveries += 1
+        restartPending = false
+        let result = I2C_ClearBusyFlagErratum(handle,
+                                              clockPin.peripheral.ptr, UInt16(clockPin.numberHal),
+                                              dataPin.peripheral.ptr, UInt16(dataPin.numberHal),
+                                              PinMux.alternate(for: clockPin, instance: address, signal: .i2cSCL))
+        if result != HAL_OK {
+            // the routine gave up with the pins still in GPIO mode
+            connect(clockPin, as: .i2cSCL)
+            connect(dataPin, as: .i2cSDA)
+            HAL_I2C_Init(handle)
+            throw STM32F4Error.timeout
+        }
+    }
+
+    /// Runs a transfer. If it fails because a slave holds the bus, the bus
+    /// is recovered before the error is rethrown, so a retry can succeed.
+    private func recovering<T>(_ transfer: () throws -> T) throws -> T {
+        do {
+            return try transfer()
+        } catch let error as STM32F4Error where error != .unknownError && busStuck {
+            try? recoverBus()
+            throw error
+        }
+    }
+
+    /// The sequential transfer option continuing the current bus transaction
+    /// and ending it with a STOP if `stop` is set.
+    private func transferOptions(stop: Bool) -> UInt32 {
+        switch (restartPending, stop) {
+        case (false, true): return I2C_FIRST_AND_LAST_FRAME
+        case (false, false): return I2C_FIRST_FRAME
+        case (true, true): return I2C_LAST_FRAME
+        case (true, false): return I2C_NEXT_FRAME
+        }
+    }
+
+    // MARK: Asynchronous transfers
+    //
+    // The buffers must stay valid until `completion` is called. These start
+    // a transfer right away and fail with `.busy` while another one is in
+    // progress; use `enqueue` to share the bus between several drivers.
+    //
+    // With `stop: false` the bus is kept and the next transfer starts with a
+    // repeated START (or, for two writes in a row, continues the same one).
+
+    public func writeAsync(address: Int, _ buffer: UnsafeBufferPointer<UInt8>, stop: Bool = true,
+                           completion: @escaping CompletionHandler) throws {
+        try checkBusAvailable()
+        try startWrite(address: address, buffer, stop: stop, completion: completion)
+    }
+
+    public func readAsync(address: Int, into buffer: UnsafeMutableBufferPointer<UInt8>, stop: Bool = true,
+                          completion: @escaping CompletionHandler) throws {
+        try checkBusAvailable()
+        try startRead(address: address, into: buffer, stop: stop, completion: completion)
+    }
+
+    /// Writes `tx`, then reads `rx` after a repeated START, without
+    /// releasing the bus in between.
+    public func writeReadAsync(address: Int, tx: UnsafeBufferPointer<UInt8>, rx: UnsafeMutableBufferPointer<UInt8>,
+                               completion: @escaping CompletionHandler) throws {
+        try criticalSection {
+            try checkBusAvailable()
+            transactionActive = true
+        }
+        do {
+            try startWriteRead(address: address, tx: tx, rx: rx) { [unowned self] error in
+                self.releaseBus()
+                completion(error)
+            }
+        } catch {
+            releaseBus()
+            throw error
+        }
+    }
+
+    /// Throws `.busy` while a queued transaction or a write-read pair owns
+    /// the bus.
+    private func checkBusAvailable() throws {
+        if transactionActive {
+            throw STM32F4Error.busy
+        }
+    }
+
+    /// Ends the ownership of a write-read pair and starts the transactions
+    /// queued meanwhile.
+    private func releaseBus() {
+        criticalSection {
+            transactionActive = false
+            startNextTransaction()
+        }
+    }
+
+    private func startWrite(address: Int, _ buffer: UnsafeBufferPointer<UInt8>, stop: Bool = true,
+                            completion: @escaping CompletionHandler) throws {
+        let options = transferOptions(stop: stop)
+        try startAsync(byteCount: buffer.count, stop: stop, completion,
+                       interrupt: {
+                           _HAL_I2C_Master_Sequential_Transmit_IT(handle, UInt16(address) << 1, buffer.baseAddress,
+                                                                  UInt16(buffer.count), options)
+                       },
+                       dma: {
+                           _HAL_I2C_Master_Transmit_DMA(handle, UInt16(address) << 1, buffer.baseAddress,
+                                                        UInt16(buffer.count))
+                       })
+    }
+
+    private func startRead(address: Int, into buffer: UnsafeMutableBufferPointer<UInt8>, stop: Bool = true,
+                           completion: @escaping CompletionHandler) throws {
+        let options = transferOptions(stop: stop)
+        try startAsync(byteCount: buffer.count, stop: stop, completion,
+                       interrupt: {
+                           HAL_I2C_Master_Sequential_Receive_IT(handle, UInt16(address) << 1, buffer.baseAddress,
+                                                                UInt16(buffer.count), options)
+                       },
+                       dma: {
+                           HAL_I2C_Master_Receive_DMA(handle, UInt16(address) << 1, buffer.baseAddress,
+                                                      UInt16(buffer.count))
+                       })
+    }
+
+    /// The transfers of `writeReadAsync`, on a bus already owned.
+    private func startWriteRead(address: Int, tx: UnsafeBufferPointer<UInt8>, rx: UnsafeMutableBufferPointer<UInt8>,
+                                completion: @escaping CompletionHandler) throws {
+        try startWrite(address: address, tx, stop: false) { [unowned self] error in
+            if let error = error {
+                completion(error)
+                return
+            }
+            // nothing may run between the write and the read
+            let failure: Error? = criticalSection {
+                do {
+                    try self.startRead(address: address, into: rx, completion: completion)
+                    return nil
+                } catch {
+                    // the write ended without a STOP
+                    self.handle.pointee.Instance.pointee.CR1 |= I2C_CR1_STOP
+                    self.restartPending = false
+                    return error
+                }
+            }
+            if let error = failure {
+                completion(error)
+            }
+        }
+    }
+
+    private func startAsync(byteCount: Int,
+                            stop: Bool,
+                            _ completion: @escaping CompletionHandler,
+                            interrupt: () -> HAL_StatusTypeDef,
+                            dma: () -> HAL_StatusTypeDef) throws {
+        // the DMA path always ends with a STOP, and the DMA receive path needs
+        // at least two bytes to NACK the last one
+        let useDMA = stop && !restartPending && byteCount >= max(dmaThreshold, 2)
+        // the running transfer owns the completion handler and the streams
+        let status: HAL_StatusTypeDef = try criticalSection {
+            guard !isBusy else {
+                throw STM32F4Error.busy
+            }
+            if useDMA {
+                try configureDMA()
+            }
+            completionHandler = completion
+            let status = useDMA ? dma() : interrupt()
+            if status == HAL_OK {
+                restartPending = !stop
+            } else {
+                completionHandler = nil
+            }
+            return status
+        }
+        try recovering { try status.throwOnFailure() }
+    }
+
+    /// Runs a sequential transfer and waits for it to finish.
+    private func transferBlocking(stop: Bool, timeout: UInt32, _ start: (UInt32) -> HAL_StatusTypeDef) throws {
+        try recovering { try start(transferOptions(stop: stop)).throwOnFailure() }
+        restartPending = !stop
+        let startTick = HAL_GetTick()
+        while HAL_I2C_GetState(handle) != HAL_I2C_STATE_READY {
+            if HAL_GetTick() &- startTick > timeout {
+                // abandon the transfer so the bus state can be examined
+                handle.pointee.Instance.pointee.CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN)
+                handle.pointee.State = HAL_I2C_STATE_READY
+                handle.pointee.Mode = HAL_I2C_MODE_NONE
+                restartPending = false
+                return try recovering { throw STM32F4Error.timeout }
+            }
+        }
+        if handle.pointee.ErrorCode != HAL_I2C_ERROR_NONE {
+            restartPending = false
+            throw STM32F4Error.unknownError
+        }
+    }
+
+    /// Writes `tx`, then reads `rx` after a repeated START, without
+    /// releasing the bus in between.
+    public func writeRead(address: Int, tx: UnsafeBufferPointer<UInt8>, rx: UnsafeMutableBufferPointer<UInt8>,
+                          timeout: TimeInterval) throws {
+        // queued transactions wait until the read has sent its STOP
+        try criticalSection {
+            try checkBusAvailable()
+            transactionActive = true
+        }
+        defer { releaseBus() }
+        try blockingWrite(address: address, buffer: tx, stop: false, timeout: timeout)
+        try blockingRead(address: address, into: rx, stop: true, timeout: timeout)
+    }
+
+    private func configureDMA() throws {
+        guard !dmaConfigured else { return }
+        // a stream claimed alone would be held for nothing
+        do {
+            try txDMA.stream.configure(for: self, channel: txDMA.channel, direction: .memoryToPeripheral,
+                                       priority: .medium)
+            try rxDMA.stream.configure(for: self, channel: rxDMA.channel, direction: .peripheralToMemory,
+                                       priority: .high)
+        } catch {
+            txDMA.stream.release(from: self)
+            rxDMA.stream.release(from: self)
+            throw error
+        }
+        txDMA.stream.link(to: handle, for: self)
+        rxDMA.stream.link(to: handle, for: self)
+        handle.pointee.hdmatx = txDMA.stream.handle
+        handle.pointee.hdmarx = rxDMA.stream.handle
+        dmaConfigured = true
+    }
+
+    fileprivate func transferCompleted(error: Error?) {
+        if error != nil {
+            // the HAL ends failed master transfers with a STOP
+            restartPending = false
+        }
+        // blocking transfers have no handler and resume the queue themselves
+        guard let completion = completionHandler else { return }
+        completionHandler = nil
+        completion(error)
+        resumeQueue()
+    }
+
+    static func handleEventInterrupt(address: UInt32) {
+        for i2c in instances where i2c.address == address {
+            HAL_I2C_EV_IRQHandler(i2c.handle)
+        }
+    }
+
+    static func handleErrorInterrupt(address: UInt32) {
+        for i2c in instances where i2c.address == address {
+            HAL_I2C_ER_IRQHandler(i2c.handle)
+        }
+    }
+}
+
+private var instances: [I2C] = []
+
+// MARK: - Transaction queue
+
+extension I2C {
+    public struct Transaction {
+        public enum Operation {
+            case write(UnsafeBufferPointer<UInt8>)
+            case read(UnsafeMutableBufferPointer<UInt8>)
+            /// A write followed by a read after a repeated START.
+            case writeRead(tx: UnsafeBufferPointer<UInt8>, rx: UnsafeMutableBufferPointer<UInt8>)
+        }
+
+        public let address: Int
+        public let operation: Operation
+        public let completion: CompletionHandler?
+
+        public init(address: Int, operation: Operation, completion: CompletionHandler? = nil) {
+            self.address = address
+            self.operation = operation
+            self.completion = completion
+        }
+    }
+
+    /// Queues an asynchronous transaction behind the ones already pending.
+    /// The buffers must stay valid until its completion is called.
+    public func enqueue(_ transaction: Transaction) throws {
+        try criticalSection {
+            guard transactionQueue.push(transaction) else {
+                throw STM32F4Error.busy
+            }
+            if !transactionActive {
+                startNextTransaction()
+            }
+        }
+    }
+
+    /// Starts queued transactions until one is running or the queue is empty.
+    /// Runs with interrupts disabled or from the completion interrupt, so
+    /// transactions are chained back to back. Queued transactions wait
+    /// while a direct transfer runs or holds the bus for a repeated START.
+    private func startNextTransaction() {
+        while !isBusy && !restartPending, let transaction = transactionQueue.pop() {
+            let completion: CompletionHandler = { [unowned self] error in
+                transaction.completion?(error)
+                self.startNextTransaction()
+            }
+            do {
+                transactionActive = true
+                switch transaction.operation {
+                case let .write(buffer):
+                    try startWrite(address: transaction.address, buffer, completion: completion)
+                case let .read(buffer):
+                    try startRead(address: transaction.address, into: buffer, completion: completion)
+                case let .writeRead(tx, rx):
+                    try startWriteRead(address: transaction.address, tx: tx, rx: rx, completion: completion)
+                }
+                return
+            } catch {
+                transactionActive = false
+                transaction.completion?(error)
+            }
+        }
+        transactionActive = false
+    }
+
+    /// Starts the transactions queued behind a direct transfer once it has
+    /// ended.
+    private func resumeQueue() {
+        criticalSection {
+            if !transactionActive && !transactionQueue.isEmpty {
+                startNextTransaction()
+            }
+        }
     }
 }
 
 extension I2C: Hardware.I2C {
     public func read(address: Int, into buffer: UnsafeMutableBufferPointer<UInt8>, stop: Bool, timeout: TimeInterval) throws {
-        precondition(stop, "I2C.write(..., stop=false) not supported")
-        let result = HAL_I2C_Master_Receive(handle, UInt16(address) << 1,
-                                            buffer.baseAddress,
-                                            UInt16(buffer.count), UInt32(timeout))
-        try result.throwOnFailure()
+        try checkBusAvailable()
+        defer { resumeQueue() }
+        try blockingRead(address: address, into: buffer, stop: stop, timeout: timeout)
     }
 
     public func write(address: Int, buffer: UnsafeBufferPointer<UInt8>, stop: Bool, timeout: TimeInterval) throws {
-        precondition(stop, "I2C.write(..., stop=false) not supported")
-        let result = _HAL_I2C_Master_Transmit(handle, UInt16(address) << 1,
-                                              buffer.baseAddress,
-                                              UInt16(buffer.count), UInt32(timeout))
-        try result.throwOnFailure()
+        try checkBusAvailable()
+        defer { resumeQueue() }
+        try blockingWrite(address: address, buffer: buffer, stop: stop, timeout: timeout)
+    }
+
+    private func blockingRead(address: Int, into buffer: UnsafeMutableBufferPointer<UInt8>, stop: Bool,
+                              timeout: TimeInterval) throws {
+        guard stop && !restartPending else {
+            return try transferBlocking(stop: stop, timeout: UInt32(timeout)) { options in
+                HAL_I2C_Master_Sequential_Receive_IT(handle, UInt16(address) << 1, buffer.baseAddress,
+                                                     UInt16(buffer.count), options)
+            }
+        }
+        try recovering {
+            try HAL_I2C_Master_Receive(handle, UInt16(address) << 1,
+                                       buffer.baseAddress,
+                                       UInt16(buffer.count), UInt32(timeout)).throwOnFailure()
+        }
+    }
+
+    private func blockingWrite(address: Int, buffer: UnsafeBufferPointer<UInt8>, stop: Bool,
+                               timeout: TimeInterval) throws {
+        guard stop && !restartPending else {
+            return try transferBlocking(stop: stop, timeout: UInt32(timeout)) { options in
+                _HAL_I2C_Master_Sequential_Transmit_IT(handle, UInt16(address) << 1, buffer.baseAddress,
+                                                       UInt16(buffer.count), options)
+            }
+        }
+        try recovering {
+            try _HAL_I2C_Master_Transmit(handle, UInt16(address) << 1,
+                                         buffer.baseAddress,
+                                         UInt16(buffer.count), UInt32(timeout)).throwOnFailure()
+        }
+    }
+}
+
+// MARK: - Clock changes
+
+extension I2C: ClockObserver {
+    public func clockWillChange(to tree: ClockTree) throws {
+        // a slave only waits for the host, its transfers never drain
+        guard registerMap == nil else { return }
+        let start = HAL_GetTick()
+        while isBusy || transactionActive {
+            if HAL_GetTick() &- start > UInt32(timeoutMs) {
+                throw STM32F4Error.timeout
+            }
+        }
+    }
+
+    /// CR2 FREQ, CCR and TRISE all derive from PCLK1; `HAL_I2C_Init`
+    /// recomputes them from the kept init struct.
+    public func clockDidChange(to tree: ClockTree) {
+        guard HAL_I2C_GetState(handle) != HAL_I2C_STATE_RESET else { return }
+        if registerMap != nil {
+            HAL_I2C_DisableListen_IT(handle)
+            HAL_I2C_Init(handle)
+            HAL_I2C_EnableListen_IT(handle)
+        } else {
+            HAL_I2C_Init(handle)
+        }
+    }
+}
+
+// MARK: - Memory access
+
+extension I2C {
+    public enum MemoryAddressSize {
+        case eightBits
+        case sixteenBits
+    }
+
+    public func readMemory(address: Int, memoryAddress: Int, addressSize: MemoryAddressSize,
+                           into buffer: UnsafeMutableBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        try checkBusAvailable()
+        try recovering {
+            try HAL_I2C_Mem_Read(handle, UInt16(address) << 1, UInt16(truncatingIfNeeded: memoryAddress),
+                                 UInt16(addressSize.hal), buffer.baseAddress,
+                                 UInt16(buffer.count), UInt32(timeout)).throwOnFailure()
+        }
+    }
+
+    public func writeMemory(address: Int, memoryAddress: Int, addressSize: MemoryAddressSize,
+                            buffer: UnsafeBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        try checkBusAvailable()
+        try recovering {
+            try _HAL_I2C_Mem_Write(handle, UInt16(address) << 1, UInt16(truncatingIfNeeded: memoryAddress),
+                                   UInt16(addressSize.hal), buffer.baseAddress,
+                                   UInt16(buffer.count), UInt32(timeout)).throwOnFailure()
+        }
+    }
+
+    /// Writes `buffer` to an EEPROM-like device, split at `pageSize`
+    /// boundaries. After each page the device is polled until it
+    /// acknowledges its address again, i.e. until the internal write cycle
+    /// is over. `timeout` applies to each page.
+    public func writePages(address: Int, memoryAddress: Int, addressSize: MemoryAddressSize, pageSize: Int,
+                           buffer: UnsafeBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        precondition(pageSize > 0, "invalid page size")
+        guard let base = buffer.baseAddress else { return }
+        var offset = 0
+        while offset < buffer.count {
+            let target = memoryAddress + offset
+            let count = min(pageSize - target % pageSize, buffer.count - offset)
+            try writeMemory(address: address, memoryAddress: target, addressSize: addressSize,
+                            buffer: UnsafeBufferPointer(start: base + offset, count: count), timeout: timeout)
+            try waitUntilReady(address: address, timeout: timeout)
+            offset += count
+        }
+    }
+
+    /// Polls the device until it acknowledges its address.
+    public func waitUntilReady(address: Int, timeout: TimeInterval) throws {
+        let start = HAL_GetTick()
+        while HAL_I2C_IsDeviceReady(handle, UInt16(address) << 1, 1, UInt32(timeout)) != HAL_OK {
+            if HAL_GetTick() &- start > UInt32(timeout) {
+                throw STM32F4Error.timeout
+            }
+        }
+    }
+}
+
+extension I2C.MemoryAddressSize {
+    var hal: UInt32 {
+        switch self {
+        case .eightBits: return I2C_MEMADD_SIZE_8BIT
+        case .sixteenBits: return I2C_MEMADD_SIZE_16BIT
+        }
     }
 }
 
 extension I2C: Hardware.I2CMemory {
     public func read(address: Int, register: UInt8, into buffer: UnsafeMutableBufferPointer<UInt8>, timeout: TimeInterval) throws {
-        let result = HAL_I2C_Mem_Read(handle, UInt16(address) << 1, UInt16(register),
-                                      UInt16(I2C_MEMADD_SIZE_8BIT), buffer.baseAddress,
-                                      UInt16(buffer.count), UInt32(timeout))
-        try result.throwOnFailure()
+        try readMemory(address: address, memoryAddress: Int(register), addressSize: .eightBits,
+                       into: buffer, timeout: timeout)
     }
 
     public func write(address: Int, register: UInt8, buffer: UnsafeBufferPointer<UInt8>, timeout: TimeInterval) throws {
-        let result = _HAL_I2C_Mem_Write(handle, UInt16(address) << 1, UInt16(register),
-                                        UInt16(I2C_MEMADD_SIZE_8BIT), buffer.baseAddress,
-                                        UInt16(buffer.count), UInt32(timeout))
-        try result.throwOnFailure()
+        try writeMemory(address: address, memoryAddress: Int(register), addressSize: .eightBits,
+                        buffer: buffer, timeout: timeout)
+    }
+}
+
+@_silgen_name("HAL_I2C_MasterTxCpltCallback")
+internal func HAL_I2C_MasterTxCpltCallback(hi2c: UnsafeMutablePointer<I2C_HandleTypeDef>) {
+    for i2c in instances where i2c.handle == hi2c {
+        i2c.transferCompleted(error: nil)
+    }
+}
+
+@_silgen_name("HAL_I2C_MasterRxCpltCallback")
+internal func HAL_I2C_MasterRxCpltCallback(hi2c: UnsafeMutablePointer<I2C_HandleTypeDef>) {
+    for i2c in instances where i2c.handle == hi2c {
+        i2c.transferCompleted(error: nil)
+    }
+}
+
+@_silgen_name("HAL_I2C_ErrorCallback")
+internal func HAL_I2C_ErrorCallback(hi2c: UnsafeMutablePointer<I2C_HandleTypeDef>) {
+    for i2c in instances where i2c.handle == hi2c {
+        if i2c.registerMap != nil {
+            i2c.slaveErrorOccurred()
+            continue
+        }
+        i2c.restartPending = false
+        let error: STM32F4Error = hi2c.pointee.ErrorCode & HAL_I2C_ERROR_TIMEOUT != 0 ? .timeout : .unknownError
+        i2c.transferCompleted(error: error)
+    }
+}
+
+@_silgen_name("HAL_I2C_AddrCallback")
+internal func HAL_I2C_AddrCallback(hi2c: UnsafeMutablePointer<I2C_HandleTypeDef>,
+                                   transferDirection: UInt8, addrMatchCode: UInt16) {
+    for i2c in instances where i2c.handle == hi2c {
+        i2c.slaveAddressMatched(direction: UInt32(transferDirection))
+    }
+}
+
+@_silgen_name("HAL_I2C_SlaveRxCpltCallback")
+internal func HAL_I2C_SlaveRxCpltCallback(hi2c: UnsafeMutablePointer<I2C_HandleTypeDef>) {
+    for i2c in instances where i2c.handle == hi2c {
+        i2c.slaveReceiveCompleted()
+    }
+}
+
+@_silgen_name("HAL_I2C_SlaveTxCpltCallback")
+internal func HAL_I2C_SlaveTxCpltCallback(hi2c: UnsafeMutablePointer<I2C_HandleTypeDef>) {
+    for i2c in instances where i2c.handle == hi2c {
+        i2c.slaveTransmitCompleted()
+    }
+}
+
+@_silgen_name("HAL_I2C_ListenCpltCallback")
+internal func HAL_I2C_ListenCpltCallback(hi2c: UnsafeMutablePointer<I2C_HandleTypeDef>) {
+    for i2c in instances where i2c.handle == hi2c {
+        i2c.slaveListenCompleted()
     }
 }
@@ -0,0 +1,163 @@
+import CSTM32F4
+
+extension I2C {
+    /// Called from interrupt context after the host wrote `registers`, once
+    /// the write ended (STOP, repeated START or wrap-around).
+    public typealias RegisterWriteHandler = (_ registers: Range<Int>) -> Void
+
+    final class RegisterMap {
+        enum Phase {
+            case idle
+            /// Receiving the register pointer, the first byte of a write.
+            case pointer
+            /// Receiving register contents at `pointer`.
+            case writing
+            /// Sending register contents from `pointer`.
+            case reading
+        }
+
+        let registers: UnsafeMutableBufferPointer<UInt8>
+        let writeHandler: RegisterWriteHandler?
+        /// Holds the pointer byte while it is received.
+        let scratch = UnsafeMutablePointer<UInt8>.allocate(capacity: 1)
+
+        var pointer = 0
+        var phase = Phase.idle
+
+        init(registers: UnsafeMutableBufferPointer<UInt8>, writeHandler: RegisterWriteHandler?) {
+            self.registers = registers
+            self.writeHandler = writeHandler
+            scratch.initialize(to: 0)
+        }
+
+        deinit {
+            scratch.deallocate()
+        }
+    }
+
+    /// Answers a host as a register-file peripheral at `ownAddress`
+    /// (7 bits). The bus must have been configured first.
+    ///
+    /// The host writes a register pointer followed by data, which lands
+    /// directly in `registers`; a read returns `registers` from the
+    /// pointer on. The pointer auto-increments and wraps at the end of the
+    /// buffer, and is kept between transactions. `registers` is owned by
+    /// the caller and must stay valid until `stopRegisterMap`; it can be
+    /// updated at any time, a read in progress may return a mix of old and
+    /// new contents.
+    public func startRegisterMap(ownAddress: Int,
+                                 registers: UnsafeMutableBufferPointer<UInt8>,
+                                 writeHandler: RegisterWriteHandler? = nil) throws {
+        precondition(registers.count > 0 && registers.count <= 256, "I2C register map must hold 1 to 256 registers")
+        precondition(ownAddress >= 0 && ownAddress < 0x80, "invalid I2C slave address")
+
+        try stopRegisterMap()
+        handle.pointee.Init.OwnAddress1 = UInt32(ownAddress) << 1
+        // clock stretching gives the callbacks time to post the next byte
+        handle.pointee.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE
+        try HAL_I2C_Init(handle).throwOnFailure()
+        registerMap = RegisterMap(registers: registers, writeHandler: writeHandler)
+        try HAL_I2C_EnableListen_IT(handle).throwOnFailure()
+    }
+
+    /// Stops answering the host. A transaction in progress is abandoned.
+    public func stopRegisterMap() throws {
+        guard registerMap != nil else { return }
+        registerMap = nil
+        HAL_I2C_DisableListen_IT(handle)
+        // drops a posted receive or transmit and releases the bus
+        try HAL_I2C_Init(handle).throwOnFailure()
+    }
+
+    /// The current register pointer, i.e. the register the next host read
+    /// starts from.
+    public var registerPointer: Int {
+        return registerMap?.pointer ?? 0
+    }
+
+    // MARK: Slave callbacks
+
+    func slaveAddressMatched(direction: UInt32) {
+        guard let map = registerMap else { return }
+        let state = handle.pointee.State
+        if state == HAL_I2C_STATE_BUSY_RX_LISTEN || state == HAL_I2C_STATE_BUSY_TX_LISTEN {
+            // repeated START: the HAL only accepts a new transfer in LISTEN,
+            // so end the posted one by hand
+            finishSlaveTransfer(map)
+            handle.pointee.Instance.pointee.CR2 &= ~I2C_CR2_ITBUFEN
+            handle.pointee.State = HAL_I2C_STATE_LISTEN
+        }
+
+        if direction == I2C_DIRECTION_TRANSMIT {
+            map.phase = .pointer
+            HAL_I2C_Slave_Sequential_Receive_IT(handle, map.scratch, 1, I2C_NEXT_FRAME)
+        } else {
+            map.phase = .reading
+            postRead(map)
+        }
+    }
+
+    func slaveReceiveCompleted() {
+        guard let map = registerMap else { return }
+        switch map.phase {
+        case .pointer:
+            map.pointer = Int(map.scratch.pointee) % map.registers.count
+            map.phase = .writing
+        case .writing:
+            // the write reached the end of the registers and wraps around
+            map.writeHandler?(map.pointer..<map.registers.count)
+            map.pointer = 0
+        case .idle, .reading:
+            return
+        }
+        HAL_I2C_Slave_Sequential_Receive_IT(handle, map.registers.baseAddress! + map.pointer,
+                                            UInt16(map.registers.count - map.pointer), I2C_NEXT_FRAME)
+    }
+
+    func slaveTransmitCompleted() {
+        guard let map = registerMap, map.phase == .reading else { return }
+        // every register up to the end has been loaded, continue from the start
+        map.pointer = 0
+        postRead(map)
+    }
+
+    /// The host ended the transaction with a STOP or a NACK.
+    func slaveListenCompleted() {
+        guard let map = registerMap else { return }
+        finishSlaveTransfer(map)
+        HAL_I2C_EnableListen_IT(handle)
+    }
+
+    func slaveErrorOccurred() {
+        guard let map = registerMap else { return }
+        // a STOP or NACK before the posted transfer finished is reported as
+        // an acknowledge failure, followed by a listen completion
+        finishSlaveTransfer(map)
+        if handle.pointee.State == HAL_I2C_STATE_READY {
+            HAL_I2C_EnableListen_IT(handle)
+        }
+    }
+
+    private func postRead(_ map: RegisterMap) {
+        HAL_I2C_Slave_Sequential_Transmit_IT(handle, map.registers.baseAddress! + map.pointer,
+                                             UInt16(map.registers.count - map.pointer), I2C_LAST_FRAME)
+    }
+
+    /// Advances the pointer past the bytes the posted transfer moved.
+    private func finishSlaveTransfer(_ map: RegisterMap) {
+        let moved = Int(handle.pointee.XferSize) - Int(handle.pointee.XferCount)
+        switch map.phase {
+        case .writing where moved > 0:
+            map.writeHandler?(map.pointer..<map.pointer + moved)
+            map.pointer = (map.pointer + moved) % map.registers.count
+        case .reading where moved > 0:
+            // the last byte loaded into DR was not clocked out before the NACK
+            map.pointer = (map.pointer + moved - 1) % map.registers.count
+        default:
+            break
+        }
+        handle.pointee.XferSize = 0
+        handle.pointee.XferCount = 0
+        map.phase = .idle
+    }
+}
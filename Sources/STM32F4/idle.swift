@@ -0,0 +1,197 @@
+import CSTM32F4
+
+extension STM32F4 {
+    public var idle: TicklessIdle {
+        return getOrCreateResource(identifier: "idle", create: TicklessIdle())
+    }
+}
+
+/// Sleeps until a deadline with SysTick stopped, instead of waking every
+/// millisecond.
+///
+/// The RTC wakeup timer ends the sleep, and the RTC calendar measures it,
+/// so `HAL_GetTick` is advanced by the time actually slept even when
+/// another interrupt wakes the core early. The F439 has no LPTIM; the RTC
+/// is its only timer running in STOP mode.
+public final class TicklessIdle {
+    public enum ClockSource {
+        /// The internal ~32 kHz RC, available on every board but only
+        /// accurate to a few percent.
+        case lsi
+        /// A 32.768 kHz crystal.
+        case lse
+    }
+
+    /// Sleeps of at least this many milliseconds enter STOP mode, shorter
+    /// ones only stop the core clock. STOP mode draws microamps instead of
+    /// milliamps, but the clock tree has to be restarted after it.
+    public var stopThreshold: UInt32 = 10
+
+    public private(set) var isConfigured = false
+
+    private let handle: UnsafeMutablePointer<RTC_HandleTypeDef>
+
+    /// Calendar sub-second counts per second.
+    private var ticksPerSecond: Int64 = 1
+    /// Wakeup timer counts per second (RTCCLK / 16).
+    private var wakeupFrequency = 1
+    /// Sub-millisecond remainder of the slept time, in ticks * 1000.
+    private var remainder: Int64 = 0
+
+    fileprivate init() {
+        handle = UnsafeMutablePointer<RTC_HandleTypeDef>.allocate(capacity: 1)
+        handle.initialize(to: RTC_HandleTypeDef())
+        handle.pointee.Instance = UnsafeMutablePointer<RTC_TypeDef>(bitPattern: UInt(RTC_BASE))!
+        instance = self
+    }
+
+    deinit {
+        handle.deallocate()
+    }
+
+    /// Starts the RTC from `clockSource`. The calendar is only used to
+    /// measure time and is not set.
+    public func configure(clockSource: ClockSource = .lsi) throws {
+        var oscInit = RCC_OscInitTypeDef()
+        var periphInit = RCC_PeriphCLKInitTypeDef()
+        periphInit.PeriphClockSelection = RCC_PERIPHCLK_RTC
+        let rtcClock: Int
+        switch clockSource {
+        case .lsi:
+            oscInit.OscillatorType = RCC_OSCILLATORTYPE_LSI
+            oscInit.LSIState = UInt32(m_RCC_LSI_ON)
+            periphInit.RTCClockSelection = RCC_RTCCLKSOURCE_LSI
+            rtcClock = 32_000
+        case .lse:
+            oscInit.OscillatorType = RCC_OSCILLATORTYPE_LSE
+            oscInit.LSEState = UInt32(RCC_LSE_ON)
+            periphInit.RTCClockSelection = RCC_RTCCLKSOURCE_LSE
+            rtcClock = 32_768
+        }
+        try HAL_RCC_OscConfig(&oscInit).throwOnFailure()
+        try HAL_RCCEx_PeriphCLKConfig(&periphInit).throwOnFailure()
+        m__HAL_RCC_RTC_ENABLE()
+
+        // a small asynchronous prescaler gives a sub-second counter with
+        // a resolution of 1/4 ms
+        let asynchronousPrescaler = 8
+        var initInfo = RTC_InitTypeDef()
+        initInfo.HourFormat = RTC_HOURFORMAT_24
+        initInfo.AsynchPrediv = UInt32(asynchronousPrescaler - 1)
+        initInfo.SynchPrediv = UInt32(rtcClock / asynchronousPrescaler - 1)
+        initInfo.OutPut = RTC_OUTPUT_DISABLE
+        initInfo.OutPutPolarity = RTC_OUTPUT_POLARITY_HIGH
+        initInfo.OutPutType = RTC_OUTPUT_TYPE_OPENDRAIN
+        handle.pointee.Init = initInfo
+        handle.pointee.State = HAL_RTC_STATE_RESET
+        try HAL_RTC_Init(handle).throwOnFailure()
+        // read the counters directly: the shadow registers need two RTCCLK
+        // cycles to resync after STOP mode
+        try HAL_RTCEx_EnableBypassShadow(handle).throwOnFailure()
+
+        ticksPerSecond = Int64(rtcClock / asynchronousPrescaler)
+        wakeupFrequency = rtcClock / 16
+        remainder = 0
+
+        HAL_NVIC_SetPriority(RTC_WKUP_IRQn, 3, 0)
+        HAL_NVIC_EnableIRQ(RTC_WKUP_IRQn)
+        isConfigured = true
+    }
+
+    /// The longest single sleep, limited by the 16 bit wakeup counter.
+    public var maximumInterval: UInt32 {
+        return UInt32(0x10000 * 1000 / wakeupFrequency)
+    }
+
+    /// Sleeps for up to `milliseconds` (at most `maximumInterval`), or until
+    /// an interrupt, and returns the milliseconds slept. `HAL_GetTick` has
+    /// been advanced by as much.
+    ///
+    /// Interrupts raised during the sleep are served after the clocks have
+    /// been restored.
+    @discardableResult
+    public func idle(for milliseconds: UInt32) -> UInt32 {
+        precondition(isConfigured, "TicklessIdle must be configured first")
+        let interval = min(milliseconds, maximumInterval)
+        let counts = Int(interval) * wakeupFrequency / 1000
+        guard counts > 0 else { return 0 }
+        guard HAL_RTCEx_SetWakeUpTimer_IT(handle, UInt32(counts - 1), RTC_WAKEUPCLOCK_RTCCLK_DIV16) == HAL_OK else {
+            return 0
+        }
+
+        let slept: UInt32 = criticalSection {
+            let start = calendarTicks
+            let startNanoseconds = MonotonicClock.nanoseconds
+            HAL_SuspendTick()
+            if interval >= stopThreshold {
+                HAL_PWREx_EnableFlashPowerDown()
+                HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, m_PWR_STOPENTRY_WFI)
+                HAL_PWREx_DisableFlashPowerDown()
+                // nothing can report a failure here; the PLL source was
+                // running before the sleep
+                try? Clock.restoreAfterStop()
+            } else {
+                HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, m_PWR_SLEEPENTRY_WFI)
+            }
+            var elapsed = calendarTicks - start
+            if elapsed < 0 {
+                elapsed += 86400 * ticksPerSecond
+            }
+            let total = remainder + elapsed * 1000
+            let slept = UInt32(total / ticksPerSecond)
+            remainder = total % ticksPerSecond
+            uwTick &+= slept
+            // the cycle counter stops with the core
+            MonotonicClock.rebase(nanoseconds: startNanoseconds + UInt64(elapsed) * 1_000_000_000 / UInt64(ticksPerSecond))
+            HAL_ResumeTick()
+            return slept
+        }
+
+        HAL_RTCEx_DeactivateWakeUpTimer(handle)
+        return slept
+    }
+
+    /// Sleeps in as many `idle` periods as needed until `milliseconds` have
+    /// passed.
+    public func sleep(milliseconds: UInt32) {
+        let deadline = HAL_GetTick() &+ milliseconds
+        var remaining = Int32(bitPattern: deadline &- HAL_GetTick())
+        while remaining > 0 {
+            idle(for: UInt32(remaining))
+            remaining = Int32(bitPattern: deadline &- HAL_GetTick())
+        }
+    }
+
+    /// The time of day in sub-second counts.
+    private var calendarTicks: Int64 {
+        let registers = handle.pointee.Instance!
+        var subSeconds: UInt32
+        var time: UInt32
+        // without shadow registers both must be read within one second
+        repeat {
+            subSeconds = registers.pointee.SSR
+            time = registers.pointee.TR
+        } while subSeconds != registers.pointee.SSR
+
+        func bcd(_ value: UInt32, tensMask: UInt32) -> Int64 {
+            return Int64((value >> 4) & tensMask) * 10 + Int64(value & 0xF)
+        }
+        let seconds = bcd(time, tensMask: 0x7)
+            + 60 * bcd(time >> 8, tensMask: 0x7)
+            + 3600 * bcd(time >> 16, tensMask: 0x3)
+        // SSR counts down from SynchPrediv
+        return seconds * ticksPerSecond + (ticksPerSecond - 1 - Int64(subSeconds))
+    }
+
+    fileprivate func handleWakeupInterrupt() {
+        HAL_RTCEx_WakeUpTimerIRQHandler(handle)
+    }
+}
+
+private var instance: TicklessIdle?
+
+extension TicklessIdle {
+    static func handleInterrupt() {
+        instance?.handleWakeupInterrupt()
+    }
+}
@@ -11,6 +11,7 @@ public func registerSysTickHandler(_ handler: @escaping SysTickHandler) {
 @_silgen_name("SysTick_Handler")
 func SysTick_Handler() {
     HAL_IncTick()
+    MonotonicClock.sample()
     HAL_SYSTICK_IRQHandler()
 }
 
@@ -23,39 +24,195 @@ func SysTick_Handler_User() {
 
 @_silgen_name("EXTI0_IRQHandler")
 func EXTI0_IRQHandler() {
-    HAL_GPIO_EXTI_IRQHandler(1 << 0)
+    GPIO.handleInterrupt(lines: 1 << 0)
 }
 
 @_silgen_name("EXTI1_IRQHandler")
 internal func EXTI1_IRQHandler() {
-    HAL_GPIO_EXTI_IRQHandler(1 << 1)
+    GPIO.handleInterrupt(lines: 1 << 1)
 }
 
 @_silgen_name("EXTI2_IRQHandler")
 internal func EXTI2_IRQHandler() {
-    HAL_GPIO_EXTI_IRQHandler(1 << 2)
+    GPIO.handleInterrupt(lines: 1 << 2)
 }
 
 @_silgen_name("EXTI3_IRQHandler")
 internal func EXTI3_IRQHandler() {
-    HAL_GPIO_EXTI_IRQHandler(1 << 3)
+    GPIO.handleInterrupt(lines: 1 << 3)
 }
 
 @_silgen_name("EXTI4_IRQHandler")
 internal func EXTI4_IRQHandler() {
-    HAL_GPIO_EXTI_IRQHandler(1 << 4)
+    GPIO.handleInterrupt(lines: 1 << 4)
 }
 
 @_silgen_name("EXTI9_5_IRQHandler")
 internal func EXTI9_5_IRQHandler() {
-    for number in 5 ... 9 {
-        HAL_GPIO_EXTI_IRQHandler(1 << number)
-    }
+    GPIO.handleInterrupt(lines: 0x03E0)
 }
 
 @_silgen_name("EXTI15_10_IRQHandler")
 internal func EXTI15_10_IRQHandler() {
-    for number in 10 ... 15 {
-        HAL_GPIO_EXTI_IRQHandler(1 << number)
-    }
+    GPIO.handleInterrupt(lines: 0xFC00)
+}
+
+@_silgen_name("TIM2_IRQHandler")
+internal func TIM2_IRQHandler() {
+    TIM.handleInterrupt(address: TIM2_BASE)
+}
+
+@_silgen_name("TIM6_DAC_IRQHandler")
+internal func TIM6_DAC_IRQHandler() {
+    TIM.handleInterrupt(address: TIM6_BASE)
+}
+
+@_silgen_name("TIM7_IRQHandler")
+internal func TIM7_IRQHandler() {
+    TIM.handleInterrupt(address: TIM7_BASE)
+}
+
+@_silgen_name("RTC_WKUP_IRQHandler")
+internal func RTC_WKUP_IRQHandler() {
+    TicklessIdle.handleInterrupt()
+}
+
+@_silgen_name("I2C1_EV_IRQHandler")
+internal func I2C1_EV_IRQHandler() {
+    I2C.handleEventInterrupt(address: I2C1_BASE)
+}
+
+@_silgen_name("I2C1_ER_IRQHandler")
+internal func I2C1_ER_IRQHandler() {
+    I2C.handleErrorInterrupt(address: I2C1_BASE)
+}
+
+@_silgen_name("I2C2_EV_IRQHandler")
+internal func I2C2_EV_IRQHandler() {
+    I2C.handleEventInterrupt(address: I2C2_BASE)
+}
+
+@_silgen_name("I2C2_ER_IRQHandler")
+internal func I2C2_ER_IRQHandler() {
+    I2C.handleErrorInterrupt(address: I2C2_BASE)
+}
+
+@_silgen_name("I2C3_EV_IRQHandler")
+internal func I2C3_EV_IRQHandler() {
+    I2C.handleEventInterrupt(address: I2C3_BASE)
+}
+
+@_silgen_name("I2C3_ER_IRQHandler")
+internal func I2C3_ER_IRQHandler() {
+    I2C.handleErrorInterrupt(address: I2C3_BASE)
+}
+
+@_silgen_name("SPI1_IRQHandler")
+internal func SPI1_IRQHandler() {
+    SPI.handleInterrupt(address: SPI1_BASE)
+}
+
+@_silgen_name("SPI2_IRQHandler")
+internal func SPI2_IRQHandler() {
+    SPI.handleInterrupt(address: SPI2_BASE)
+}
+
+@_silgen_name("SPI3_IRQHandler")
+internal func SPI3_IRQHandler() {
+    SPI.handleInterrupt(address: SPI3_BASE)
+}
+
+@_silgen_name("USART1_IRQHandler")
+internal func USART1_IRQHandler() {
+    UART.handleInterrupt(address: USART1_BASE)
+}
+
+@_silgen_name("USART3_IRQHandler")
+internal func USART3_IRQHandler() {
+    UART.handleInterrupt(address: USART3_BASE)
+}
+
+@_silgen_name("USART6_IRQHandler")
+internal func USART6_IRQHandler() {
+    UART.handleInterrupt(address: USART6_BASE)
+}
+
+@_silgen_name("DMA1_Stream0_IRQHandler")
+internal func DMA1_Stream0_IRQHandler() {
+    DMA.Stream.dma1Stream0.handleInterrupt()
+}
+
+@_silgen_name("DMA1_Stream1_IRQHandler")
+internal func DMA1_Stream1_IRQHandler() {
+    DMA.Stream.dma1Stream1.handleInterrupt()
+}
+
+@_silgen_name("DMA1_Stream2_IRQHandler")
+internal func DMA1_Stream2_IRQHandler() {
+    DMA.Stream.dma1Stream2.handleInterrupt()
+}
+
+@_silgen_name("DMA1_Stream3_IRQHandler")
+internal func DMA1_Stream3_IRQHandler() {
+    DMA.Stream.dma1Stream3.handleInterrupt()
+}
+
+@_silgen_name("DMA1_Stream4_IRQHandler")
+internal func DMA1_Stream4_IRQHandler() {
+    DMA.Stream.dma1Stream4.handleInterrupt()
+}
+
+@_silgen_name("DMA1_Stream5_IRQHandler")
+internal func DMA1_Stream5_IRQHandler() {
+    DMA.Stream.dma1Stream5.handleInterrupt()
+}
+
+@_silgen_name("DMA1_Stream6_IRQHandler")
+internal func DMA1_Stream6_IRQHandler() {
+    DMA.Stream.dma1Stream6.handleInterrupt()
+}
+
+@_silgen_name("DMA1_Stream7_IRQHandler")
+internal func DMA1_Stream7_IRQHandler() {
+    DMA.Stream.dma1Stream7.handleInterrupt()
+}
+
+@_silgen_name("DMA2_Stream0_IRQHandler")
+internal func DMA2_Stream0_IRQHandler() {
+    DMA.Stream.dma2Stream0.handleInterrupt()
+}
+
+@_silgen_name("DMA2_Stream1_IRQHandler")
+internal func DMA2_Stream1_IRQHandler() {
+    DMA.Stream.dma2Stream1.handleInterrupt()
+}
+
+@_silgen_name("DMA2_Stream2_IRQHandler")
+internal func DMA2_Stream2_IRQHandler() {
+    DMA.Stream.dma2Stream2.handleInterrupt()
+}
+
+@_silgen_name("DMA2_Stream3_IRQHandler")
+internal func DMA2_Stream3_IRQHandler() {
+    DMA.Stream.dma2Stream3.handleInterrupt()
+}
+
+@_silgen_name("DMA2_Stream4_IRQHandler")
+internal func DMA2_Stream4_IRQHandler() {
+    DMA.Stream.dma2Stream4.handleInterrupt()
+}
+
+@_silgen_name("DMA2_Stream5_IRQHandler")
+internal func DMA2_Stream5_IRQHandler() {
+    DMA.Stream.dma2Stream5.handleInterrupt()
+}
+
+@_silgen_name("DMA2_Stream6_IRQHandler")
+internal func DMA2_Stream6_IRQHandler() {
+    DMA.Stream.dma2Stream6.handleInterrupt()
+}
+
+@_silgen_name("DMA2_Stream7_IRQHandler")
+internal func DMA2_Stream7_IRQHandler() {
+    DMA.Stream.dma2Stream7.handleInterrupt()
 }
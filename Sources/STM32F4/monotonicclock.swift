@@ -0,0 +1,112 @@
+import CSTM32F4
+import STM32F4Support
+
+extension STM32F4 {
+    /// Nanoseconds since `init`, see `MonotonicClock`.
+    public var uptime: UInt64 {
+        return MonotonicClock.nanoseconds
+    }
+}
+
+/// A 64-bit monotonic clock with the resolution of the CPU clock, started
+/// by `STM32F4.init`.
+///
+/// The 32-bit DWT cycle counter is extended with an overflow count. Every
+/// read compares it with the previous one, and SysTick reads it every
+/// millisecond, well within the 25 s it takes to wrap at 168 MHz. Reads
+/// run with interrupts masked, so a read from an interrupt cannot see half
+/// an update.
+///
+/// Cycles are converted at the HCLK frequency in force since the last clock
+/// change. `STM32F4.setClock` and `TicklessIdle` rebase the conversion, so
+/// `nanoseconds` keeps counting through frequency changes and sleeps, while
+/// `cycles` stops while the core sleeps.
+public enum MonotonicClock {
+    private static var overflows: UInt32 = 0
+    private static var lastCount: UInt32 = 0
+
+    private static var frequency: UInt64 = 1
+    private static var baseCycles: UInt64 = 0
+    private static var baseNanoseconds: UInt64 = 0
+
+    public private(set) static var isRunning = false
+
+    private static let tracker = FrequencyTracker()
+
+    static func start(frequency: Int) {
+        CycleCounter.enable()
+        criticalSection {
+            self.frequency = UInt64(frequency)
+            baseCycles = extendedCycles()
+            baseNanoseconds = 0
+        }
+        if !isRunning {
+            Clock.observers.append(tracker)
+            isRunning = true
+        }
+    }
+
+    /// CPU cycles counted since the counter was enabled.
+    public static var cycles: UInt64 {
+        return criticalSection { extendedCycles() }
+    }
+
+    public static var nanoseconds: UInt64 {
+        return criticalSection { nanoseconds(atCycles: extendedCycles()) }
+    }
+
+    public static var microseconds: UInt64 {
+        return nanoseconds / 1000
+    }
+
+    /// Keeps the overflow count up to date; called from SysTick.
+    static func sample() {
+        if isRunning {
+            _ = cycles
+        }
+    }
+
+    /// Continues at `nanoseconds` from now on, or where the clock stands,
+    /// converting at `frequency` Hz.
+    static func rebase(nanoseconds: UInt64? = nil, frequency: Int? = nil) {
+        guard isRunning else { return }
+        criticalSection {
+            let now = extendedCycles()
+            baseNanoseconds = nanoseconds ?? self.nanoseconds(atCycles: now)
+            baseCycles = now
+            if let frequency = frequency {
+                self.frequency = UInt64(frequency)
+            }
+        }
+    }
+
+    /// Must run with interrupts masked.
+    private static func extendedCycles() -> UInt64 {
+        let count = CycleCounter.now
+        if count < lastCount {
+            overflows &+= 1
+        }
+        lastCount = count
+        return UInt64(overflows) << 32 | UInt64(count)
+    }
+
+    private static func nanoseconds(atCycles cycles: UInt64) -> UInt64 {
+        let elapsed = cycles &- baseCycles
+        // split so the product does not overflow after ~100 s
+        return baseNanoseconds
+            + elapsed / frequency * 1_000_000_000
+            + elapsed % frequency * 1_000_000_000 / frequency
+    }
+}
+
+/// Rebases `MonotonicClock` around clock tree changes. The few microseconds
+/// spent switching are counted at the old frequency.
+private final class FrequencyTracker: ClockObserver {
+    func clockWillChange(to tree: ClockTree) throws {
+        MonotonicClock.rebase()
+    }
+
+    func clockDidChange(to tree: ClockTree) {
+        MonotonicClock.rebase(frequency: tree.hclk)
+    }
+}
@@ -0,0 +1,156 @@
+import CSTM32F4
+
+extension GPIO {
+    /// Several pins of one port, written and read together. Values are
+    /// port-aligned: bit n is pin n, bits outside `mask` are ignored.
+    public struct PinGroup {
+        public let peripheral: Peripheral
+        public let mask: UInt16
+
+        public init(peripheral: Peripheral, mask: UInt16) {
+            self.peripheral = peripheral
+            self.mask = mask
+        }
+
+        public init(peripheral: Peripheral, pins: [Int]) {
+            var mask: UInt16 = 0
+            for number in pins {
+                precondition(number >= 0 && number < 16, "invalid pin number")
+                mask |= 1 << UInt16(number)
+            }
+            self.init(peripheral: peripheral, mask: mask)
+        }
+
+        /// Configures every pin of the group with a single `HAL_GPIO_Init`.
+        /// Interrupt modes are configured per pin.
+        public func configure(_ mode: Pin.Mode) {
+            switch mode {
+            case .interrupt, .rawInterrupt, .capture:
+                preconditionFailure("interrupts must be configured on the individual pins")
+            default:
+                break
+            }
+            peripheral.enableClock()
+            var config = mode.initStruct(pins: UInt32(mask))
+            HAL_GPIO_Init(peripheral.ptr, &config)
+        }
+
+        /// The BSRR word driving the group to `value`.
+        @inlinable
+        public func setResetWord(for value: UInt16) -> UInt32 {
+            return UInt32(~value & mask) << 16 | UInt32(value & mask)
+        }
+
+        /// Drives all pins of the group at once; the other pins of the port
+        /// are not touched.
+        @inlinable
+        public func write(_ value: UInt16) {
+            LL_GPIO_SetOutputPin(peripheral.ptr, setResetWord(for: value))
+        }
+
+        @inlinable
+        public func read() -> UInt16 {
+            return UInt16(truncatingIfNeeded: LL_GPIO_ReadInputPort(peripheral.ptr)) & mask
+        }
+    }
+}
+
+/// A parallel data bus on consecutive pins of one port, e.g. the 8/16 bit
+/// interface of an LCD controller. Values are right-aligned: bit 0 is on
+/// `firstPin`.
+public final class ParallelBus {
+    public let group: GPIO.PinGroup
+    public let firstPin: Int
+    public let width: Int
+
+    private var timer: TIM?
+
+    public init(peripheral: GPIO.Peripheral, firstPin: Int, width: Int) {
+        precondition(width > 0 && firstPin >= 0 && firstPin + width <= 16, "invalid parallel bus pins")
+        self.firstPin = firstPin
+        self.width = width
+        let mask = UInt16(truncatingIfNeeded: (1 << width) - 1) << UInt16(firstPin)
+        group = GPIO.PinGroup(peripheral: peripheral, mask: mask)
+    }
+
+    public func configure(_ mode: GPIO.Pin.Mode = .output) {
+        group.configure(mode)
+    }
+
+    @inlinable
+    public func write(_ value: UInt16) {
+        group.write(value << UInt16(firstPin))
+    }
+
+    @inlinable
+    public func read() -> UInt16 {
+        return group.read() >> UInt16(firstPin)
+    }
+
+    /// Converts values to the BSRR words `stream` writes, so the DMA
+    /// transfer needs no further processing.
+    public func encode(_ values: UnsafeBufferPointer<UInt16>, into words: UnsafeMutableBufferPointer<UInt32>) {
+        precondition(words.count >= values.count, "BSRR buffer too small")
+        for (index, value) in values.enumerated() {
+            words[index] = group.setResetWord(for: value << UInt16(firstPin))
+        }
+    }
+
+    /// Writes `words` (see `encode`) to the port, one per update event of
+    /// `timer` at `frequency` Hz, by DMA. `words` must stay valid until
+    /// `completion` is called from interrupt context.
+    ///
+    /// Only DMA2 can write to the GPIO ports, so the timer must be TIM1 or
+    /// TIM8. Returns the frequency actually reached.
+    @discardableResult
+    public func stream(_ words: UnsafeBufferPointer<UInt32>, timer: TIM, frequency: Int,
+                       completion: @escaping DMA.Stream.CompletionHandler) throws -> Int {
+        guard let request = timer.updateDMA else {
+            preconditionFailure("the timer has no update DMA request on DMA2")
+        }
+        guard self.timer == nil else {
+            throw STM32F4Error.busy
+        }
+        guard let source = words.baseAddress, words.count > 0 else {
+            completion(nil)
+            return 0
+        }
+
+        let reached = try timer.configure(frequency: frequency)
+        try request.stream.configure(for: self, channel: request.channel, direction: .memoryToPeripheral,
+                                     priority: .high, dataSize: .word)
+        let destination = UnsafeMutableRawPointer(group.peripheral.ptr)
+            + MemoryLayout<GPIO_TypeDef>.offset(of: \GPIO_TypeDef.BSRR)!
+        do {
+            try request.stream.start(for: self, from: source, to: destination,
+                                     count: words.count) { [unowned self] error in
+                timer.enableUpdateDMA(false)
+                try? timer.stop()
+                self.timer = nil
+                request.stream.release(from: self)
+                completion(error)
+            }
+        } catch {
+            request.stream.release(from: self)
+            throw error
+        }
+        self.timer = timer
+        timer.enableUpdateDMA(true)
+        try timer.start()
+        return reached
+    }
+
+    /// Stops a transfer started with `stream`; its completion is not called.
+    public func stopStreaming() {
+        guard let timer = timer, let request = timer.updateDMA else { return }
+        timer.enableUpdateDMA(false)
+        try? timer.stop()
+        request.stream.release(from: self)
+        self.timer = nil
+    }
+
+    /// `true` while a `stream` transfer is running.
+    public var isStreaming: Bool {
+        return timer != nil
+    }
+}
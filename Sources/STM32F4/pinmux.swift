@@ -0,0 +1,154 @@
+import CSTM32F4
+
+/// Alternate-function assignments of the serial peripherals.
+///
+/// The candidate pins are the option lists of the DFP's `RTE_Device.h`,
+/// narrowed down to the ones the STM32F42x/43x actually route (DS9405,
+/// table 12); the alternate-function numbers come from the same table.
+enum PinMux {
+    enum Signal {
+        case spiSCK
+        case spiMISO
+        case spiMOSI
+        case spiNSS
+        case i2cSCL
+        case i2cSDA
+        case uartTX
+        case uartRX
+        case uartCTS
+        case uartRTS
+    }
+
+    struct Entry {
+        let instance: UInt32
+        let signal: Signal
+        let port: GPIO.Peripheral
+        let pin: Int
+        let alternate: UInt8
+    }
+
+    /// FMPI2C1, which the F42x/43x headers do not declare.
+    static let fmpi2c1: UInt32 = APB1PERIPH_BASE + 0x6000
+
+    /// The alternate function connecting `pin` to `signal` of the peripheral
+    /// at `instance`. Traps if the pin cannot carry that signal.
+    static func alternate(for pin: GPIO.Pin, instance: UInt32, signal: Signal) -> UInt32 {
+        for entry in table where entry.instance == instance && entry.signal == signal
+            && entry.port === pin.peripheral && entry.pin == pin.number {
+            return UInt32(entry.alternate)
+        }
+        preconditionFailure("pin \(pin.number) of the given port cannot be used as \(signal) of this instance")
+    }
+
+    static let table: [Entry] = [
+        // SPI1
+        Entry(instance: SPI1_BASE, signal: .spiNSS, port: .A, pin: 4, alternate: GPIO_AF5_SPI1),
+        Entry(instance: SPI1_BASE, signal: .spiNSS, port: .A, pin: 15, alternate: GPIO_AF5_SPI1),
+        Entry(instance: SPI1_BASE, signal: .spiSCK, port: .A, pin: 5, alternate: GPIO_AF5_SPI1),
+        Entry(instance: SPI1_BASE, signal: .spiSCK, port: .B, pin: 3, alternate: GPIO_AF5_SPI1),
+        Entry(instance: SPI1_BASE, signal: .spiMISO, port: .A, pin: 6, alternate: GPIO_AF5_SPI1),
+        Entry(instance: SPI1_BASE, signal: .spiMISO, port: .B, pin: 4, alternate: GPIO_AF5_SPI1),
+        Entry(instance: SPI1_BASE, signal: .spiMOSI, port: .A, pin: 7, alternate: GPIO_AF5_SPI1),
+        Entry(instance: SPI1_BASE, signal: .spiMOSI, port: .B, pin: 5, alternate: GPIO_AF5_SPI1),
+        // SPI2
+        Entry(instance: SPI2_BASE, signal: .spiNSS, port: .B, pin: 9, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiNSS, port: .B, pin: 12, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiNSS, port: .I, pin: 0, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiSCK, port: .B, pin: 10, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiSCK, port: .B, pin: 13, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiSCK, port: .D, pin: 3, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiSCK, port: .I, pin: 1, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiMISO, port: .B, pin: 14, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiMISO, port: .C, pin: 2, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiMISO, port: .I, pin: 2, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiMOSI, port: .B, pin: 15, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiMOSI, port: .C, pin: 3, alternate: GPIO_AF5_SPI2),
+        Entry(instance: SPI2_BASE, signal: .spiMOSI, port: .I, pin: 3, alternate: GPIO_AF5_SPI2),
+        // SPI3
+        Entry(instance: SPI3_BASE, signal: .spiNSS, port: .A, pin: 4, alternate: GPIO_AF6_SPI3),
+        Entry(instance: SPI3_BASE, signal: .spiNSS, port: .A, pin: 15, alternate: GPIO_AF6_SPI3),
+        Entry(instance: SPI3_BASE, signal: .spiSCK, port: .B, pin: 3, alternate: GPIO_AF6_SPI3),
+        Entry(instance: SPI3_BASE, signal: .spiSCK, port: .C, pin: 10, alternate: GPIO_AF6_SPI3),
+        Entry(instance: SPI3_BASE, signal: .spiMISO, port: .B, pin: 4, alternate: GPIO_AF6_SPI3),
+        Entry(instance: SPI3_BASE, signal: .spiMISO, port: .C, pin: 11, alternate: GPIO_AF6_SPI3),
+        Entry(instance: SPI3_BASE, signal: .spiMOSI, port: .B, pin: 5, alternate: GPIO_AF6_SPI3),
+        Entry(instance: SPI3_BASE, signal: .spiMOSI, port: .C, pin: 12, alternate: GPIO_AF6_SPI3),
+        Entry(instance: SPI3_BASE, signal: .spiMOSI, port: .D, pin: 6, alternate: GPIO_AF5_SPI3),
+        // I2C1
+        Entry(instance: I2C1_BASE, signal: .i2cSCL, port: .B, pin: 6, alternate: GPIO_AF4_I2C1),
+        Entry(instance: I2C1_BASE, signal: .i2cSCL, port: .B, pin: 8, alternate: GPIO_AF4_I2C1),
+        Entry(instance: I2C1_BASE, signal: .i2cSDA, port: .B, pin: 7, alternate: GPIO_AF4_I2C1),
+        Entry(instance: I2C1_BASE, signal: .i2cSDA, port: .B, pin: 9, alternate: GPIO_AF4_I2C1),
+        // I2C2
+        Entry(instance: I2C2_BASE, signal: .i2cSCL, port: .B, pin: 10, alternate: GPIO_AF4_I2C2),
+        Entry(instance: I2C2_BASE, signal: .i2cSCL, port: .F, pin: 1, alternate: GPIO_AF4_I2C2),
+        Entry(instance: I2C2_BASE, signal: .i2cSCL, port: .H, pin: 4, alternate: GPIO_AF4_I2C2),
+        Entry(instance: I2C2_BASE, signal: .i2cSDA, port: .B, pin: 11, alternate: GPIO_AF4_I2C2),
+        Entry(instance: I2C2_BASE, signal: .i2cSDA, port: .F, pin: 0, alternate: GPIO_AF4_I2C2),
+        Entry(instance: I2C2_BASE, signal: .i2cSDA, port: .H, pin: 5, alternate: GPIO_AF4_I2C2),
+        // I2C3
+        Entry(instance: I2C3_BASE, signal: .i2cSCL, port: .A, pin: 8, alternate: GPIO_AF4_I2C3),
+        Entry(instance: I2C3_BASE, signal: .i2cSCL, port: .H, pin: 7, alternate: GPIO_AF4_I2C3),
+        Entry(instance: I2C3_BASE, signal: .i2cSDA, port: .C, pin: 9, alternate: GPIO_AF4_I2C3),
+        Entry(instance: I2C3_BASE, signal: .i2cSDA, port: .H, pin: 8, alternate: GPIO_AF4_I2C3),
+        // FMPI2C1, the union of the F410, F412, F413/F423 and F446 pinouts
+        // (DS10086, DS11139, DS11581, DS10693); PB10 is on AF9 where it
+        // exists, everything else on AF4
+        Entry(instance: fmpi2c1, signal: .i2cSCL, port: .B, pin: 10, alternate: 9),
+        Entry(instance: fmpi2c1, signal: .i2cSCL, port: .B, pin: 15, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSCL, port: .C, pin: 6, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSCL, port: .D, pin: 12, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSCL, port: .D, pin: 14, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSCL, port: .F, pin: 14, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSDA, port: .B, pin: 3, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSDA, port: .B, pin: 14, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSDA, port: .C, pin: 7, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSDA, port: .D, pin: 13, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSDA, port: .D, pin: 15, alternate: 4),
+        Entry(instance: fmpi2c1, signal: .i2cSDA, port: .F, pin: 15, alternate: 4),
+        // USART1
+        Entry(instance: USART1_BASE, signal: .uartTX, port: .A, pin: 9, alternate: GPIO_AF7_USART1),
+        Entry(instance: USART1_BASE, signal: .uartTX, port: .B, pin: 6, alternate: GPIO_AF7_USART1),
+        Entry(instance: USART1_BASE, signal: .uartRX, port: .A, pin: 10, alternate: GPIO_AF7_USART1),
+        Entry(instance: USART1_BASE, signal: .uartRX, port: .B, pin: 7, alternate: GPIO_AF7_USART1),
+        Entry(instance: USART1_BASE, signal: .uartCTS, port: .A, pin: 11, alternate: GPIO_AF7_USART1),
+        Entry(instance: USART1_BASE, signal: .uartRTS, port: .A, pin: 12, alternate: GPIO_AF7_USART1),
+        // USART2
+        Entry(instance: USART2_BASE, signal: .uartTX, port: .A, pin: 2, alternate: GPIO_AF7_USART2),
+        Entry(instance: USART2_BASE, signal: .uartTX, port: .D, pin: 5, alternate: GPIO_AF7_USART2),
+        Entry(instance: USART2_BASE, signal: .uartRX, port: .A, pin: 3, alternate: GPIO_AF7_USART2),
+        Entry(instance: USART2_BASE, signal: .uartRX, port: .D, pin: 6, alternate: GPIO_AF7_USART2),
+        Entry(instance: USART2_BASE, signal: .uartCTS, port: .A, pin: 0, alternate: GPIO_AF7_USART2),
+        Entry(instance: USART2_BASE, signal: .uartCTS, port: .D, pin: 3, alternate: GPIO_AF7_USART2),
+        Entry(instance: USART2_BASE, signal: .uartRTS, port: .A, pin: 1, alternate: GPIO_AF7_USART2),
+        Entry(instance: USART2_BASE, signal: .uartRTS, port: .D, pin: 4, alternate: GPIO_AF7_USART2),
+        // USART3
+        Entry(instance: USART3_BASE, signal: .uartTX, port: .B, pin: 10, alternate: GPIO_AF7_USART3),
+        Entry(instance: USART3_BASE, signal: .uartTX, port: .C, pin: 10, alternate: GPIO_AF7_USART3),
+        Entry(instance: USART3_BASE, signal: .uartTX, port: .D, pin: 8, alternate: GPIO_AF7_USART3),
+        Entry(instance: USART3_BASE, signal: .uartRX, port: .B, pin: 11, alternate: GPIO_AF7_USART3),
+        Entry(instance: USART3_BASE, signal: .uartRX, port: .C, pin: 11, alternate: GPIO_AF7_USART3),
+        Entry(instance: USART3_BASE, signal: .uartRX, port: .D, pin: 9, alternate: GPIO_AF7_USART3),
+        Entry(instance: USART3_BASE, signal: .uartCTS, port: .B, pin: 13, alternate: GPIO_AF7_USART3),
+        Entry(instance: USART3_BASE, signal: .uartCTS, port: .D, pin: 11, alternate: GPIO_AF7_USART3),
+        Entry(instance: USART3_BASE, signal: .uartRTS, port: .B, pin: 14, alternate: GPIO_AF7_USART3),
+        Entry(instance: USART3_BASE, signal: .uartRTS, port: .D, pin: 12, alternate: GPIO_AF7_USART3),
+        // UART4
+        Entry(instance: UART4_BASE, signal: .uartTX, port: .A, pin: 0, alternate: GPIO_AF8_UART4),
+        Entry(instance: UART4_BASE, signal: .uartTX, port: .C, pin: 10, alternate: GPIO_AF8_UART4),
+        Entry(instance: UART4_BASE, signal: .uartRX, port: .A, pin: 1, alternate: GPIO_AF8_UART4),
+        Entry(instance: UART4_BASE, signal: .uartRX, port: .C, pin: 11, alternate: GPIO_AF8_UART4),
+        // UART5
+        Entry(instance: UART5_BASE, signal: .uartTX, port: .C, pin: 12, alternate: GPIO_AF8_UART5),
+        Entry(instance: UART5_BASE, signal: .uartRX, port: .D, pin: 2, alternate: GPIO_AF8_UART5),
+        // USART6
+        Entry(instance: USART6_BASE, signal: .uartTX, port: .C, pin: 6, alternate: GPIO_AF8_USART6),
+        Entry(instance: USART6_BASE, signal: .uartTX, port: .G, pin: 14, alternate: GPIO_AF8_USART6),
+        Entry(instance: USART6_BASE, signal: .uartRX, port: .C, pin: 7, alternate: GPIO_AF8_USART6),
+        Entry(instance: USART6_BASE, signal: .uartRX, port: .G, pin: 9, alternate: GPIO_AF8_USART6),
+        Entry(instance: USART6_BASE, signal: .uartCTS, port: .G, pin: 13, alternate: GPIO_AF8_USART6),
+        Entry(instance: USART6_BASE, signal: .uartCTS, port: .G, pin: 15, alternate: GPIO_AF8_USART6),
+        Entry(instance: USART6_BASE, signal: .uartRTS, port: .G, pin: 8, alternate: GPIO_AF8_USART6),
+        Entry(instance: USART6_BASE, signal: .uartRTS, port: .G, pin: 12, alternate: GPIO_AF8_USART6),
+    ]
+}
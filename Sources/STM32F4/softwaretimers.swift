@@ -0,0 +1,152 @@
+import CSTM32F4
+import STM32F4Support
+
+/// Runs any number of one-shot and periodic callbacks from one 32 bit
+/// timer, to the microsecond.
+///
+/// The timer counts microseconds freely, extended to 64 bits by its update
+/// interrupt, and channel 1 compares the counter against the next event of
+/// a `TimerWheel`. The wheel jumps from event to event, so the interrupt
+/// only fires when a timer is due or moves down a level, not on every tick.
+///
+/// Callbacks run either in the timer's interrupt or, `deferred`, from
+/// `runDeferred` in the main loop. `schedule` and `cancel` may be called
+/// from either, and from interrupts of the timer's priority or lower.
+public final class SoftwareTimers {
+    public typealias Callback = () -> Void
+    public typealias Timer = TimerWheel<Entry>.Timer
+
+    public enum Dispatch {
+        /// In the timer interrupt, with the latency of the interrupt.
+        case interrupt
+        /// Queued for `runDeferred`.
+        case deferred
+    }
+
+    public struct Entry {
+        let callback: Callback
+        let dispatch: Dispatch
+    }
+
+    private static let tickFrequency = 1_000_000
+
+    public let timer: TIM
+
+    private let wheel: TimerWheel<Entry>
+    private let deferred: RingBuffer<Callback>
+    private var overflows: UInt32 = 0
+
+    /// Number of deferred callbacks lost because the queue was full.
+    public private(set) var dropped = 0
+
+    /// Counts on `timer`, which must have a 32 bit counter (TIM2), with
+    /// room for `capacity` timers at once. The timer clock must be a
+    /// multiple of 1 MHz, as it is with every `ClockTree` derived from an
+    /// 8 MHz source.
+    public init(timer: TIM, capacity: Int = 64, queueCapacity: Int = 16) throws {
+        precondition(timer.counterBits == 32, "SoftwareTimers needs a 32 bit timer")
+        self.timer = timer
+        wheel = TimerWheel<Entry>(capacity: capacity)
+        deferred = RingBuffer<Callback>(capacity: queueCapacity)
+        let reached = try timer.configure(tickFrequency: SoftwareTimers.tickFrequency)
+        precondition(reached == SoftwareTimers.tickFrequency, "the timer clock is not a multiple of 1 MHz")
+    }
+
+    public func start() throws {
+        try timer.start { [unowned self] in
+            self.overflows &+= 1
+            self.service()
+        }
+        timer.startCompare { [unowned self] in
+            self.service()
+        }
+    }
+
+    public func stop() throws {
+        try timer.stop()
+    }
+
+    /// Microseconds since `start`. The timer stops in STOP mode.
+    public var now: UInt64 {
+        return criticalSection {
+            var high = overflows
+            let count = timer.counter
+            // an overflow whose interrupt is still pending; a count past
+            // half the range was read before it
+            if timer.isUpdatePending && count < 0x8000_0000 {
+                high &+= 1
+            }
+            return UInt64(high) << 32 | UInt64(count)
+        }
+    }
+
+    /// Calls `callback` in `microseconds`, then every `period` microseconds
+    /// if `period` is not zero. Returns `nil` if `capacity` timers are
+    /// already scheduled.
+    @discardableResult
+    public func schedule(after microseconds: UInt64, period: UInt64 = 0, dispatch: Dispatch = .interrupt,
+                         _ callback: @escaping Callback) -> Timer? {
+        return criticalSection {
+            let entry = Entry(callback: callback, dispatch: dispatch)
+            guard let scheduled = wheel.schedule(at: now + microseconds, period: period, entry) else {
+                return nil
+            }
+            rearm()
+            return scheduled
+        }
+    }
+
+    /// Returns `false` if `timer` had already fired or been cancelled.
+    /// A deferred callback already queued still runs.
+    @discardableResult
+    public func cancel(_ timer: Timer) -> Bool {
+        // an earlier compare match left armed only costs a spurious interrupt
+        return criticalSection { wheel.cancel(timer) }
+    }
+
+    public func isScheduled(_ timer: Timer) -> Bool {
+        return criticalSection { wheel.isScheduled(timer) }
+    }
+
+    /// Runs the deferred callbacks due so far, and returns how many ran.
+    @discardableResult
+    public func runDeferred() -> Int {
+        var count = 0
+        while let callback = deferred.pop() {
+            callback()
+            count += 1
+        }
+        return count
+    }
+
+    /// Runs the timers due, from the timer interrupt.
+    private func service() {
+        wheel.advance(to: now) { _, entry in
+            switch entry.dispatch {
+            case .interrupt:
+                entry.callback()
+            case .deferred:
+                if !deferred.push(entry.callback) {
+                    dropped += 1
+                }
+            }
+        }
+        rearm()
+    }
+
+    /// Points the compare channel at the next event. Must run with
+    /// interrupts masked or from the timer interrupt.
+    private func rearm() {
+        guard let event = wheel.nextEvent else { return }
+        let current = now
+        if event > current {
+            // beyond this revolution of the counter the update interrupt
+            // comes first
+            guard event >> 32 == current >> 32 else { return }
+            timer.setCompare(UInt32(truncatingIfNeeded: event))
+            // a match while arming would have been discarded
+            guard now >= event else { return }
+        }
+        timer.triggerCompare()
+    }
+}
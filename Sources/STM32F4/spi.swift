@@ -1,5 +1,6 @@
 import CSTM32F4
 import Hardware
+import STM32F4Support
 
 extension STM32F4 {
     public var spi: SPI {
@@ -7,7 +8,14 @@ extension STM32F4 {
             identifier: "spi_1",
             create: SPI(address: SPI1_BASE,
                         enableClock: m__HAL_RCC_SPI1_CLK_ENABLE,
-                        clockFrequencyGetter: HAL_RCC_GetPCLK2Freq)
+                        resetPeripheral: {
+                            m__HAL_RCC_SPI1_FORCE_RESET()
+                            m__HAL_RCC_SPI1_RELEASE_RESET()
+                        },
+                        clockFrequencyGetter: HAL_RCC_GetPCLK2Freq,
+                        interruptNumber: SPI1_IRQn,
+                        txDMA: .spi1Tx,
+                        rxDMA: .spi1Rx)
         )
     }
 
@@ -16,7 +24,14 @@ extension STM32F4 {
             identifier: "spi_2",
             create: SPI(address: SPI2_BASE,
                         enableClock: m__HAL_RCC_SPI2_CLK_ENABLE,
-                        clockFrequencyGetter: HAL_RCC_GetPCLK1Freq)
+                        resetPeripheral: {
+                            m__HAL_RCC_SPI2_FORCE_RESET()
+                            m__HAL_RCC_SPI2_RELEASE_RESET()
+                        },
+                        clockFrequencyGetter: HAL_RCC_GetPCLK1Freq,
+                        interruptNumber: SPI2_IRQn,
+                        txDMA: .spi2Tx,
+                        rxDMA: .spi2Rx)
         )
     }
 
@@ -25,7 +40,14 @@ extension STM32F4 {
             identifier: "spi_3",
             create: SPI(address: SPI3_BASE,
                         enableClock: m__HAL_RCC_SPI3_CLK_ENABLE,
-                        clockFrequencyGetter: HAL_RCC_GetPCLK1Freq)
+                        resetPeripheral: {
+                            m__HAL_RCC_SPI3_FORCE_RESET()
+                            m__HAL_RCC_SPI3_RELEASE_RESET()
+                        },
+                        clockFrequencyGetter: HAL_RCC_GetPCLK1Freq,
+                        interruptNumber: SPI3_IRQn,
+                        txDMA: .spi3Tx,
+                        rxDMA: .spi3Rx)
         )
     }
 }
@@ -33,8 +55,101 @@ extension STM32F4 {
 public final class SPI {
     var handle: UnsafeMutablePointer<SPI_HandleTypeDef>
 
+    let address: UInt32
     let enableClock: () -> Void
+    let resetPeripheral: () -> Void
     let getClockFrequency: () -> UInt32
+    let interruptNumber: IRQn_Type
+    let txDMA: DMA.Request
+    let rxDMA: DMA.Request
+
+    /// Called from interrupt context once an asynchronous transfer finishes,
+    /// with `nil` on success.
+    public typealias CompletionHandler = (Error?) -> Void
+
+    private var completionHandler: CompletionHandler?
+    var dmaConfigured = false
+    var dmaMode: DMA.Mode = .normal
+    var dataSize: DataSize = .eightBits
+
+    /// The SCK frequency requested as a master, kept to retime the
+    /// prescaler when the bus clock changes.
+    private var masterFrequency: Frequency?
+
+    let transactionQueue = RingBuffer<Transaction>(capacity: 16)
+    var transactionActive = false
+
+    /// The hardware NSS input when configured as a slave.
+    var slaveSelectInput: GPIO.Pin?
+    var slaveSession: SlaveSession?
+
+    /// Whether the LL polling path can drive the current configuration
+    /// (full-duplex master without hardware CRC).
+    private(set) var pollingSupported = false
+
+    public enum Strategy {
+        /// Polled through the LL driver, bypassing the HAL state machine.
+        case polling
+        /// Driven by the TXE/RXNE interrupts.
+        case interrupt
+        /// Driven by the DMA streams.
+        case dma
+    }
+
+    /// Transfer sizes, in bytes, at which the asynchronous transfers switch
+    /// strategy. Transfers shorter than `interrupt` are polled, transfers of
+    /// at least `dma` bytes use DMA, everything in between uses interrupts.
+    ///
+    /// The defaults are a starting point; `measureStrategies` finds the
+    /// crossovers for a given bus clock and frame size.
+    public struct Thresholds {
+        public var interrupt: Int
+        public var dma: Int
+
+        public init(interrupt: Int = 8, dma: Int = 64) {
+            precondition(interrupt <= dma, "invalid SPI thresholds")
+            self.interrupt = interrupt
+            self.dma = dma
+        }
+    }
+
+    /// Transfers and bytes per strategy, and through the HAL's blocking
+    /// functions for the blocking transfers the LL path does not take.
+    public struct Statistics {
+        public private(set) var transfers: (polling: Int, interrupt: Int, dma: Int, blocking: Int) = (0, 0, 0, 0)
+        public private(set) var bytes: (polling: Int, interrupt: Int, dma: Int, blocking: Int) = (0, 0, 0, 0)
+
+        mutating func record(_ strategy: Strategy, byteCount: Int) {
+            switch strategy {
+            case .polling:
+                transfers.polling += 1
+                bytes.polling += byteCount
+            case .interrupt:
+                transfers.interrupt += 1
+                bytes.interrupt += byteCount
+            case .dma:
+                transfers.dma += 1
+                bytes.dma += byteCount
+            }
+        }
+
+        mutating func recordBlocking(byteCount: Int) {
+            transfers.blocking += 1
+            bytes.blocking += byteCount
+        }
+    }
+
+    public var thresholds = Thresholds()
+
+    public internal(set) var statistics = Statistics()
+
+    public func resetStatistics() {
+        statistics = Statistics()
+    }
+
+    /// Bounds the waits that have no caller-supplied timeout: polled
+    /// asynchronous transfers and draining before a clock change.
+    private static let timeoutMs: UInt32 = 5000
 
     public enum Frequency {
         case prescaler(Int)
@@ -84,17 +199,18 @@ public final class SPI {
     }
 
     public struct Configuration {
-        var sck: GPIO.Pin
-        var miso: GPIO.Pin
-        var mosi: GPIO.Pin
-        var mode: Mode = .master(frequency: .baudrate(328_125))
-        var direction: Direction = .twoLines
-        var dataSize: DataSize = .eightBits
-        var polarity: Polarity = .high
-        var phase: Phase = .firstEdge
-        var firstBit: FirstBit = .msb
-        var crc: CRC = .disabled
-        var tiMode = false
+        public var sck: GPIO.Pin
+        public var miso: GPIO.Pin
+        public var mosi: GPIO.Pin
+        public var mode: Mode = .master(frequency: .baudrate(328_125))
+        public var direction: Direction = .twoLines
+        public var dataSize: DataSize = .eightBits
+        public var polarity: Polarity = .high
+        public var phase: Phase = .firstEdge
+        public var firstBit: FirstBit = .msb
+        public var crc: CRC = .disabled
+        public var tiMode = false
+        public var slaveSelect: SlaveSelect = .soft
 
         public init(sck: GPIO.Pin, miso: GPIO.Pin, mosi: GPIO.Pin) {
             self.sck = sck
@@ -105,29 +221,54 @@ public final class SPI {
 
     fileprivate init(address: UInt32,
                      enableClock: @escaping () -> Void,
-                     clockFrequencyGetter: @escaping () -> UInt32) {
+                     resetPeripheral: @escaping () -> Void,
+                     clockFrequencyGetter: @escaping () -> UInt32,
+                     interruptNumber: IRQn_Type,
+                     txDMA: DMA.Request,
+                     rxDMA: DMA.Request) {
         handle = UnsafeMutablePointer<SPI_HandleTypeDef>.allocate(capacity: 1)
         handle.initialize(repeating: SPI_HandleTypeDef(), count: 1)
         handle.pointee.Instance = UnsafeMutablePointer<SPI_TypeDef>(
             bitPattern: UInt(address)
         )!
+        self.address = address
         self.enableClock = enableClock
+        self.resetPeripheral = resetPeripheral
         getClockFrequency = clockFrequencyGetter
+        self.interruptNumber = interruptNumber
+        self.txDMA = txDMA
+        self.rxDMA = rxDMA
+        instances.append(self)
+        Clock.observers.append(self)
     }
 
     deinit {
+        txDMA.stream.release(from: self)
+        rxDMA.stream.release(from: self)
         self.handle.deallocate()
     }
 
     public func configure(_ config: Configuration) throws {
         // connect pins
-        // TODO: GPIO_AF6_SPI3
-        let pinConfig = GPIO_InitTypeDef(Pin: 0, Mode: UInt32(GPIO_MODE_AF_PP),
-                                         Pull: GPIO_NOPULL, Speed: GPIO_SPEED_FREQ_HIGH,
-                                         Alternate: UInt32(GPIO_AF6_SPI3))
-        config.sck.configure(.manual(hal: pinConfig))
-        config.mosi.configure(.manual(hal: pinConfig))
-        config.miso.configure(.manual(hal: pinConfig))
+        func connect(_ pin: GPIO.Pin, as signal: PinMux.Signal) {
+            let pinConfig = GPIO_InitTypeDef(Pin: 0, Mode: UInt32(GPIO_MODE_AF_PP),
+                                             Pull: GPIO_NOPULL, Speed: GPIO_SPEED_FREQ_VERY_HIGH,
+                                             Alternate: PinMux.alternate(for: pin, instance: address, signal: signal))
+            pin.configure(.manual(hal: pinConfig))
+        }
+        connect(config.sck, as: .spiSCK)
+        connect(config.mosi, as: .spiMOSI)
+        connect(config.miso, as: .spiMISO)
+        switch config.slaveSelect {
+        case .soft:
+            slaveSelectInput = nil
+        case let .hardInput(pin):
+            connect(pin, as: .spiNSS)
+            slaveSelectInput = pin
+        case let .hardOuptut(pin):
+            connect(pin, as: .spiNSS)
+            slaveSelectInput = nil
+        }
         enableClock()
 
         handle.pointee.Init = config.toHAL(
@@ -135,14 +276,293 @@ public final class SPI {
         )
 
         try HAL_SPI_Init(handle).throwOnFailure()
+        dataSize = config.dataSize
+        if case let .master(frequency) = config.mode {
+            masterFrequency = frequency
+        } else {
+            masterFrequency = nil
+        }
+        txDMA.stream.release(from: self)
+        rxDMA.stream.release(from: self)
+        dmaConfigured = false
+        if case .master = config.mode, config.direction == .twoLines, case .disabled = config.crc {
+            pollingSupported = true
+        } else {
+            pollingSupported = false
+        }
+
+        HAL_NVIC_SetPriority(interruptNumber, 3, 0)
+        HAL_NVIC_EnableIRQ(interruptNumber)
+    }
+
+    /// `true` while an asynchronous transfer is in progress.
+    public var isBusy: Bool {
+        return HAL_SPI_GetState(handle) != HAL_SPI_STATE_READY
+    }
+
+    /// Number of data frames in `byteCount` bytes, which must be whole
+    /// frames.
+    func frameCount(_ byteCount: Int) -> UInt16 {
+        precondition(dataSize == .eightBits || byteCount % 2 == 0, "odd byte count with 16 bit frames")
+        switch dataSize {
+        case .eightBits: return UInt16(byteCount)
+        case .sixteenBits: return UInt16(byteCount / 2)
+        }
+    }
+
+    /// The strategy an asynchronous transfer of `byteCount` bytes uses.
+    public func strategy(forByteCount byteCount: Int) -> Strategy {
+        if byteCount >= thresholds.dma {
+            return .dma
+        } else if byteCount >= thresholds.interrupt || !pollingSupported {
+            return .interrupt
+        } else {
+            return .polling
+        }
+    }
+
+    /// `timeout` is in milliseconds, as for the other buses.
+    public func receive(into buffer: UnsafeMutableBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        if pollingSupported, buffer.count < thresholds.interrupt {
+            statistics.record(.polling, byteCount: buffer.count)
+            return try pollingTransfer(tx: nil, rx: buffer.baseAddress, byteCount: buffer.count,
+                                       timeout: UInt32(timeout))
+        }
+        statistics.recordBlocking(byteCount: buffer.count)
+        try HAL_SPI_Receive(handle, buffer.baseAddress, frameCount(buffer.count),
+                            UInt32(timeout)).throwOnFailure()
+    }
+
+    public func transfer(tx: UnsafeBufferPointer<UInt8>, rx: UnsafeMutableBufferPointer<UInt8>,
+                         timeout: TimeInterval) throws {
+        precondition(tx.count == rx.count, "SPI.transfer buffers must have the same size")
+        if pollingSupported, tx.count < thresholds.interrupt {
+            statistics.record(.polling, byteCount: tx.count)
+            return try pollingTransfer(tx: tx.baseAddress, rx: rx.baseAddress, byteCount: tx.count,
+                                       timeout: UInt32(timeout))
+        }
+        statistics.recordBlocking(byteCount: tx.count)
+        try _HAL_SPI_TransmitReceive(handle, tx.baseAddress, rx.baseAddress, frameCount(tx.count),
+                                     UInt32(timeout)).throwOnFailure()
+    }
+
+    /// Full-duplex transfer polled through the LL driver. Missing transmit
+    /// data is sent as 0xFF, received data is dropped when `rx` is nil.
+    /// 16 bit frames are stored little-endian, as the HAL paths store them.
+    ///
+    /// The HAL state is held at BUSY meanwhile, so no interrupt or DMA
+    /// transfer starts over it, and it fails with `.busy` if one is running.
+    private func pollingTransfer(tx: UnsafePointer<UInt8>?, rx: UnsafeMutablePointer<UInt8>?,
+                                 byteCount: Int, timeout: UInt32 = SPI.timeoutMs) throws {
+        precondition(dataSize == .eightBits || byteCount % 2 == 0, "odd byte count with 16 bit frames")
+        try criticalSection {
+            guard !isBusy else {
+                throw STM32F4Error.busy
+            }
+            handle.pointee.State = HAL_SPI_STATE_BUSY
+        }
+        defer { handle.pointee.State = HAL_SPI_STATE_READY }
+        let registers = handle.pointee.Instance!
+        if LL_SPI_IsEnabled(registers) == 0 {
+            LL_SPI_Enable(registers)
+        }
+        let start = HAL_GetTick()
+        func wait(until flag: @autoclosure () -> Bool) throws {
+            while !flag() {
+                if HAL_GetTick() &- start > timeout {
+                    throw STM32F4Error.timeout
+                }
+            }
+        }
+        let step = dataSize == .eightBits ? 1 : 2
+        var index = 0
+        while index + step <= byteCount {
+            try wait(until: LL_SPI_IsActiveFlag_TXE(registers) != 0)
+            if step == 1 {
+                LL_SPI_TransmitData8(registers, tx?[index] ?? 0xFF)
+            } else {
+                let word = tx.map { UInt16($0[index]) | UInt16($0[index + 1]) << 8 } ?? 0xFFFF
+                LL_SPI_TransmitData16(registers, word)
+            }
+            try wait(until: LL_SPI_IsActiveFlag_RXNE(registers) != 0)
+            if step == 1 {
+                let byte = LL_SPI_ReceiveData8(registers)
+                rx?[index] = byte
+            } else {
+                let word = LL_SPI_ReceiveData16(registers)
+                rx?[index] = UInt8(truncatingIfNeeded: word)
+                rx?[index + 1] = UInt8(truncatingIfNeeded: word >> 8)
+            }
+            index += step
+        }
+        try wait(until: LL_SPI_IsActiveFlag_BSY(registers) == 0)
+    }
+
+    // MARK: Asynchronous transfers
+    //
+    // The buffers must stay valid until `completion` is called. Transfers
+    // below `thresholds.interrupt` complete, and call `completion`, before
+    // returning.
+
+    public func sendAsync(_ buffer: UnsafeBufferPointer<UInt8>, completion: @escaping CompletionHandler) throws {
+        try startAsync(byteCount: buffer.count, strategy: strategy(forByteCount: buffer.count), completion,
+                       polling: { try pollingTransfer(tx: buffer.baseAddress, rx: nil, byteCount: buffer.count) },
+                       interrupt: { _HAL_SPI_Transmit_IT(handle, buffer.baseAddress, frameCount(buffer.count)) },
+                       dma: { _HAL_SPI_Transmit_DMA(handle, buffer.baseAddress, frameCount(buffer.count)) })
+    }
+
+    public func receiveAsync(into buffer: UnsafeMutableBufferPointer<UInt8>,
+                             completion: @escaping CompletionHandler) throws {
+        try startAsync(byteCount: buffer.count, strategy: strategy(forByteCount: buffer.count), completion,
+                       polling: { try pollingTransfer(tx: nil, rx: buffer.baseAddress, byteCount: buffer.count) },
+                       interrupt: { HAL_SPI_Receive_IT(handle, buffer.baseAddress, frameCount(buffer.count)) },
+                       dma: { HAL_SPI_Receive_DMA(handle, buffer.baseAddress, frameCount(buffer.count)) })
+    }
+
+    public func transferAsync(tx: UnsafeBufferPointer<UInt8>, rx: UnsafeMutableBufferPointer<UInt8>,
+                              completion: @escaping CompletionHandler) throws {
+        try transferAsync(tx: tx, rx: rx, strategy: strategy(forByteCount: tx.count), completion: completion)
+    }
+
+    /// `transferAsync` with the strategy forced, for `measureStrategies`.
+    func transferAsync(tx: UnsafeBufferPointer<UInt8>, rx: UnsafeMutableBufferPointer<UInt8>,
+                       strategy: Strategy, completion: @escaping CompletionHandler) throws {
+        precondition(tx.count == rx.count, "SPI.transfer buffers must have the same size")
+        try startAsync(byteCount: tx.count, strategy: strategy, completion,
+                       polling: { try pollingTransfer(tx: tx.baseAddress, rx: rx.baseAddress, byteCount: tx.count) },
+                       interrupt: {
+                           _HAL_SPI_TransmitReceive_IT(handle, tx.baseAddress, rx.baseAddress, frameCount(tx.count))
+                       },
+                       dma: {
+                           _HAL_SPI_TransmitReceive_DMA(handle, tx.baseAddress, rx.baseAddress, frameCount(tx.count))
+                       })
+    }
+
+    private func startAsync(byteCount: Int,
+                            strategy: Strategy,
+                            _ completion: @escaping CompletionHandler,
+                            polling: () throws -> Void,
+                            interrupt: () -> HAL_StatusTypeDef,
+                            dma: () -> HAL_StatusTypeDef) throws {
+        precondition(strategy != .polling || pollingSupported, "the configuration cannot be polled")
+        if strategy == .polling {
+            try polling()
+            statistics.record(strategy, byteCount: byteCount)
+            completion(nil)
+            return
+        }
+        try criticalSection {
+            // the HAL would refuse a second transfer only after its
+            // completion handler had replaced the running one's
+            guard !isBusy else {
+                throw STM32F4Error.busy
+            }
+            if strategy == .dma {
+                try configureDMA()
+            }
+            completionHandler = completion
+            let status: HAL_StatusTypeDef
+            switch strategy {
+            case .interrupt:
+                status = interrupt()
+            case .dma:
+                status = dma()
+            case .polling:
+                preconditionFailure("not an interrupt or DMA strategy")
+            }
+            do {
+                try status.throwOnFailure()
+            } catch {
+                completionHandler = nil
+                throw error
+            }
+            statistics.record(strategy, byteCount: byteCount)
+        }
+    }
+
+    func configureDMA(mode: DMA.Mode = .normal) throws {
+        guard !dmaConfigured || dmaMode != mode else { return }
+        let dmaDataSize: DMA.DataSize = dataSize == .eightBits ? .byte : .halfWord
+        // a stream claimed alone would be held for nothing
+        do {
+            try txDMA.stream.configure(for: self, channel: txDMA.channel, direction: .memoryToPeripheral,
+                                       mode: mode, priority: .medium, dataSize: dmaDataSize)
+            try rxDMA.stream.configure(for: self, channel: rxDMA.channel, direction: .peripheralToMemory,
+                                       mode: mode, priority: .high, dataSize: dmaDataSize)
+        } catch {
+            txDMA.stream.release(from: self)
+            rxDMA.stream.release(from: self)
+            dmaConfigured = false
+            throw error
+        }
+        txDMA.stream.link(to: handle, for: self)
+        rxDMA.stream.link(to: handle, for: self)
+        handle.pointee.hdmatx = txDMA.stream.handle
+        handle.pointee.hdmarx = rxDMA.stream.handle
+        dmaMode = mode
+        dmaConfigured = true
+    }
+
+    fileprivate func transferCompleted(error: Error?) {
+        let completion = completionHandler
+        completionHandler = nil
+        completion?(error)
+        // transactions queued behind a direct transfer
+        if !transactionActive && !transactionQueue.isEmpty {
+            startNextTransaction()
+        }
+    }
+
+    static func handleInterrupt(address: UInt32) {
+        for spi in instances where spi.address == address {
+            HAL_SPI_IRQHandler(spi.handle)
+        }
     }
 }
 
+private var instances: [SPI] = []
+
 extension SPI: Hardware.SPI {
-    public func send(_ buffer: UnsafeBufferPointer<UInt8>, timeout _: TimeInterval) throws {
-        try _HAL_SPI_Transmit(handle, buffer.baseAddress, UInt16(buffer.count),
-                              UInt32(5000)).throwOnFailure()
-        while HAL_SPI_GetState(handle) != HAL_SPI_STATE_READY {}
+    public func send(_ buffer: UnsafeBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        if pollingSupported, buffer.count < thresholds.interrupt {
+            statistics.record(.polling, byteCount: buffer.count)
+            return try pollingTransfer(tx: buffer.baseAddress, rx: nil, byteCount: buffer.count,
+                                       timeout: UInt32(timeout))
+        }
+        statistics.recordBlocking(byteCount: buffer.count)
+        let start = HAL_GetTick()
+        try _HAL_SPI_Transmit(handle, buffer.baseAddress, frameCount(buffer.count),
+                              UInt32(timeout)).throwOnFailure()
+        while HAL_SPI_GetState(handle) != HAL_SPI_STATE_READY {
+            if HAL_GetTick() &- start > UInt32(timeout) {
+                throw STM32F4Error.timeout
+            }
+        }
+    }
+}
+
+extension SPI: ClockObserver {
+    public func clockWillChange(to tree: ClockTree) throws {
+        guard masterFrequency != nil else { return }
+        let start = HAL_GetTick()
+        while isBusy {
+            if HAL_GetTick() &- start > SPI.timeoutMs {
+                throw STM32F4Error.timeout
+            }
+        }
+    }
+
+    public func clockDidChange(to tree: ClockTree) {
+        guard let frequency = masterFrequency else { return }
+        let prescaler = SPI.Configuration.selectPrescaler(
+            frequency, peripheralClockFrequency: Int(getClockFrequency())
+        )
+        handle.pointee.Init.BaudRatePrescaler = prescaler
+        // BR must not change while SPE is set; the HAL enables the
+        // peripheral again on the next transfer
+        let registers = handle.pointee.Instance!
+        registers.pointee.CR1 &= ~SPI_CR1_SPE
+        registers.pointee.CR1 = registers.pointee.CR1 & ~SPI_CR1_BR | prescaler
     }
 }
 
@@ -153,8 +573,9 @@ extension SPI.Configuration {
         switch mode {
         case let .master(frequency):
             config.Mode = m_SPI_MODE_MASTER
-            config.BaudRatePrescaler = selectPrescaler(frequency,
-                                                       peripheralClockFrequency: peripheralClockFrequency)
+            config.BaudRatePrescaler = SPI.Configuration.selectPrescaler(
+                frequency, peripheralClockFrequency: peripheralClockFrequency
+            )
         case .slave:
             config.Mode = SPI_MODE_SLAVE
         }
@@ -211,12 +632,19 @@ extension SPI.Configuration {
             config.TIMode = SPI_TIMODE_ENABLE
         }
 
-        config.NSS = SPI_NSS_SOFT
+        switch slaveSelect {
+        case .soft:
+            config.NSS = SPI_NSS_SOFT
+        case .hardInput:
+            config.NSS = SPI_NSS_HARD_INPUT
+        case .hardOuptut:
+            config.NSS = SPI_NSS_HARD_OUTPUT
+        }
 
         return config
     }
 
-    func selectPrescaler(_ frequency: SPI.Frequency, peripheralClockFrequency: Int) -> UInt32 {
+    static func selectPrescaler(_ frequency: SPI.Frequency, peripheralClockFrequency: Int) -> UInt32 {
         let prescale: Int
         switch frequency {
         case let .baudrate(baudrate):
@@ -235,3 +663,40 @@ extension SPI.Configuration {
         else { return SPI_BAUDRATEPRESCALER_256 }
     }
 }
+
+@_silgen_name("HAL_SPI_TxCpltCallback")
+internal func HAL_SPI_TxCpltCallback(hspi: UnsafeMutablePointer<SPI_HandleTypeDef>) {
+    for spi in instances where spi.handle == hspi {
+        spi.transferCompleted(error: nil)
+    }
+}
+
+@_silgen_name("HAL_SPI_RxCpltCallback")
+internal func HAL_SPI_RxCpltCallback(hspi: UnsafeMutablePointer<SPI_HandleTypeDef>) {
+    for spi in instances where spi.handle == hspi {
+        spi.transferCompleted(error: nil)
+    }
+}
+
+@_silgen_name("HAL_SPI_TxRxCpltCallback")
+internal func HAL_SPI_TxRxCpltCallback(hspi: UnsafeMutablePointer<SPI_HandleTypeDef>) {
+    for spi in instances where spi.handle == hspi {
+        if let session = spi.slaveSession {
+            // the circular receive buffer wrapped within a frame
+            session.overflowed = true
+        } else {
+            spi.transferCompleted(error: nil)
+        }
+    }
+}
+
+@_silgen_name("HAL_SPI_ErrorCallback")
+internal func HAL_SPI_ErrorCallback(hspi: UnsafeMutablePointer<SPI_HandleTypeDef>) {
+    for spi in instances where spi.handle == hspi {
+        if let session = spi.slaveSession {
+            session.failed = true
+        } else {
+            spi.transferCompleted(error: STM32F4Error.unknownError)
+        }
+    }
+}
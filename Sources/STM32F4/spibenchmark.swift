@@ -0,0 +1,122 @@
+import CSTM32F4
+
+extension SPI {
+    /// The cost of full-duplex transfers of one size with one strategy,
+    /// averaged over the repetitions of `measureStrategies`.
+    public struct Measurement {
+        public let byteCount: Int
+        public let strategy: Strategy
+        /// CPU cycles from the call to the completion.
+        public let latency: Int
+        /// CPU cycles taken from the caller, in the call and in the
+        /// transfer's interrupts: `latency` minus the cycles the caller had
+        /// to itself while waiting for the completion.
+        public let cpuCycles: Int
+    }
+
+    /// Times full-duplex transfers of each of `byteCounts` with every
+    /// asynchronous strategy the configuration supports, with the cycle
+    /// counter. The bus must be configured and idle, with no device selected;
+    /// nothing needs to be connected, as the data clocked in is discarded.
+    ///
+    /// The cycles left to the caller are counted as iterations of the wait
+    /// loop, calibrated beforehand, so `cpuCycles` is an estimate to within
+    /// a few cycles per interrupt. `Thresholds(measurements:)` turns the
+    /// result into crossovers. `statistics` are left untouched.
+    public func measureStrategies(byteCounts: [Int] = [1, 2, 4, 8, 16, 32, 64, 128, 256],
+                                  repetitions: Int = 8) throws -> [Measurement] {
+        precondition(repetitions > 0, "invalid repetition count")
+        try criticalSection {
+            guard !transactionActive, !isBusy else {
+                throw STM32F4Error.busy
+            }
+            transactionActive = true
+        }
+        defer { release() }
+
+        let capacity = byteCounts.max() ?? 0
+        let tx = UnsafeMutableBufferPointer<UInt8>.allocate(capacity: capacity)
+        tx.initialize(repeating: 0x55)
+        let rx = UnsafeMutableBufferPointer<UInt8>.allocate(capacity: capacity)
+        rx.initialize(repeating: 0)
+        defer {
+            tx.deallocate()
+            rx.deallocate()
+        }
+
+        let savedStatistics = statistics
+        defer { statistics = savedStatistics }
+        CycleCounter.enable()
+        let cyclesPerIteration = measureWaitIteration()
+
+        let strategies: [Strategy] = pollingSupported ? [.polling, .interrupt, .dma] : [.interrupt, .dma]
+        var measurements: [Measurement] = []
+        for requested in byteCounts {
+            // whole frames only
+            let byteCount = dataSize == .sixteenBits ? requested & ~1 : requested
+            guard byteCount > 0 else { continue }
+            let txFrames = UnsafeBufferPointer(rebasing: tx[..<byteCount])
+            let rxFrames = UnsafeMutableBufferPointer(rebasing: rx[..<byteCount])
+            for strategy in strategies {
+                var latency = 0
+                var iterations = 0
+                var failure: Error?
+                for _ in 0..<repetitions {
+                    let start = CycleCounter.now
+                    try transferAsync(tx: txFrames, rx: rxFrames, strategy: strategy) { error in
+                        failure = failure ?? error
+                    }
+                    while isBusy {
+                        iterations += 1
+                    }
+                    latency += Int(CycleCounter.now &- start)
+                }
+                if let error = failure {
+                    throw error
+                }
+                let idle = Int(Double(iterations) * cyclesPerIteration)
+                measurements.append(Measurement(byteCount: byteCount, strategy: strategy,
+                                                latency: latency / repetitions,
+                                                cpuCycles: max(latency - idle, 0) / repetitions))
+            }
+        }
+        return measurements
+    }
+
+    /// The cycles one iteration of the wait loop in `measureStrategies`
+    /// takes with the bus idle.
+    private func measureWaitIteration() -> Double {
+        let iterations = 1000
+        var count = 0
+        let start = CycleCounter.now
+        while count < iterations {
+            if isBusy {
+                break
+            }
+            count += 1
+        }
+        return Double(CycleCounter.now &- start) / Double(iterations)
+    }
+}
+
+extension SPI.Thresholds {
+    /// The crossovers in `measurements`: each size goes to the strategy
+    /// taking the fewest CPU cycles, from the smallest measured size at
+    /// which it wins on. A strategy that never wins is never used.
+    public init(measurements: [SPI.Measurement]) {
+        var interrupt = Int.max
+        var dma = Int.max
+        let byteCounts = Set(measurements.map { $0.byteCount }).sorted()
+        for byteCount in byteCounts {
+            let candidates = measurements.filter { $0.byteCount == byteCount }
+            guard let best = candidates.min(by: { $0.cpuCycles < $1.cpuCycles }) else { continue }
+            if best.strategy != .polling {
+                interrupt = min(interrupt, byteCount)
+            }
+            if best.strategy == .dma {
+                dma = min(dma, byteCount)
+            }
+        }
+        self.init(interrupt: min(interrupt, dma), dma: dma)
+    }
+}
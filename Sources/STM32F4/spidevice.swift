@@ -0,0 +1,192 @@
+import CSTM32F4
+import Hardware
+
+extension SPI {
+    /// Creates a device sharing this bus. The bus must have been configured
+    /// as a master; the device only overrides the clock, mode and frame format.
+    public func device(chipSelect: GPIO.Pin, settings: SPIDevice.Settings) -> SPIDevice {
+        return SPIDevice(bus: self, chipSelect: chipSelect, settings: settings)
+    }
+}
+
+/// A device on a shared SPI bus, selected by its own chip-select pin.
+public final class SPIDevice {
+    public struct Settings {
+        public var frequency: SPI.Frequency
+        public var polarity: SPI.Polarity
+        public var phase: SPI.Phase
+        public var firstBit: SPI.FirstBit
+        public var dataSize: SPI.DataSize
+
+        public init(frequency: SPI.Frequency,
+                    polarity: SPI.Polarity = .high,
+                    phase: SPI.Phase = .firstEdge,
+                    firstBit: SPI.FirstBit = .msb,
+                    dataSize: SPI.DataSize = .eightBits) {
+            self.frequency = frequency
+            self.polarity = polarity
+            self.phase = phase
+            self.firstBit = firstBit
+            self.dataSize = dataSize
+        }
+    }
+
+    public let bus: SPI
+    public let chipSelect: GPIO.Pin
+    public let settings: Settings
+
+    fileprivate init(bus: SPI, chipSelect: GPIO.Pin, settings: Settings) {
+        self.bus = bus
+        self.chipSelect = chipSelect
+        self.settings = settings
+        chipSelect.configure(.output)
+        chipSelect.set(.high)
+    }
+
+    /// Blocking full-duplex transfer with the chip select asserted.
+    public func transfer(tx: UnsafeBufferPointer<UInt8>, rx: UnsafeMutableBufferPointer<UInt8>,
+                         timeout: TimeInterval) throws {
+        try bus.acquire(for: self)
+        defer { bus.release() }
+        chipSelect.set(.low)
+        defer { chipSelect.set(.high) }
+        try bus.transfer(tx: tx, rx: rx, timeout: timeout)
+    }
+
+    /// Blocking write with the chip select asserted.
+    public func send(_ buffer: UnsafeBufferPointer<UInt8>, timeout: TimeInterval) throws {
+        try bus.acquire(for: self)
+        defer { bus.release() }
+        chipSelect.set(.low)
+        defer { chipSelect.set(.high) }
+        try bus.send(buffer, timeout: timeout)
+    }
+
+    /// Queues an asynchronous transaction. The buffers must stay valid until
+    /// `completion` is called.
+    public func enqueue(_ operation: SPI.Transaction.Operation,
+                        completion: SPI.CompletionHandler? = nil) throws {
+        try bus.enqueue(SPI.Transaction(device: self, operation: operation, completion: completion))
+    }
+}
+
+extension SPIDevice.Settings {
+    /// The CR1 bits owned by a device.
+    static let registerMask: UInt32 = SPI_CR1_BR | SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_LSBFIRST | SPI_CR1_DFF
+
+    func registerValue(peripheralClockFrequency: Int) -> UInt32 {
+        var value = SPI.Configuration.selectPrescaler(frequency, peripheralClockFrequency: peripheralClockFrequency)
+        if polarity == .high { value |= SPI_POLARITY_HIGH }
+        if phase == .secondEdge { value |= SPI_PHASE_2EDGE }
+        if firstBit == .lsb { value |= SPI_FIRSTBIT_LSB }
+        if dataSize == .sixteenBits { value |= SPI_DATASIZE_16BIT }
+        return value
+    }
+}
+
+extension SPI {
+    public struct Transaction {
+        public enum Operation {
+            case send(UnsafeBufferPointer<UInt8>)
+            case receive(UnsafeMutableBufferPointer<UInt8>)
+            case transfer(tx: UnsafeBufferPointer<UInt8>, rx: UnsafeMutableBufferPointer<UInt8>)
+        }
+
+        public let device: SPIDevice
+        public let operation: Operation
+        public let completion: CompletionHandler?
+    }
+
+    /// Reprograms only the CR1 bits that differ between the current
+    /// configuration and `device`. Must not be called during a transfer.
+    func select(_ device: SPIDevice) throws {
+        let registers = handle.pointee.Instance!
+        let value = device.settings.registerValue(peripheralClockFrequency: Int(getClockFrequency()))
+        let mask = SPIDevice.Settings.registerMask
+        let current = registers.pointee.CR1
+        guard current & mask != value else { return }
+        if isBusy {
+            throw STM32F4Error.busy
+        }
+        // DFF and BR may only change while the peripheral is disabled
+        registers.pointee.CR1 = (current & ~(mask | SPI_CR1_SPE)) | value
+        registers.pointee.CR1 = (current & ~mask) | value
+        // keep the HAL's view in sync, it picks the 8/16 bit paths from Init
+        handle.pointee.Init.BaudRatePrescaler = value & SPI_CR1_BR
+        handle.pointee.Init.CLKPolarity = value & SPI_CR1_CPOL
+        handle.pointee.Init.CLKPhase = value & SPI_CR1_CPHA
+        handle.pointee.Init.FirstBit = value & SPI_CR1_LSBFIRST
+        handle.pointee.Init.DataSize = value & SPI_CR1_DFF
+        if dataSize != device.settings.dataSize {
+            dataSize = device.settings.dataSize
+            // the DMA streams use the frame size as their data width
+            dmaConfigured = false
+        }
+    }
+
+    /// Reserves the bus for a blocking transfer of `device`: throws `busy`
+    /// while a transaction is running, and holds queued ones back until
+    /// `release`.
+    func acquire(for device: SPIDevice) throws {
+        try criticalSection {
+            guard !transactionActive, !isBusy else {
+                throw STM32F4Error.busy
+            }
+            try select(device)
+            transactionActive = true
+        }
+    }
+
+    /// Ends a blocking transfer and starts the transactions queued meanwhile.
+    func release() {
+        criticalSection {
+            transactionActive = false
+            startNextTransaction()
+        }
+    }
+
+    func enqueue(_ transaction: Transaction) throws {
+        try criticalSection {
+            guard transactionQueue.push(transaction) else {
+                throw STM32F4Error.busy
+            }
+            if !transactionActive {
+                startNextTransaction()
+            }
+        }
+    }
+
+    /// Starts queued transactions until one is running or the queue is empty.
+    /// Runs with interrupts disabled or from the completion interrupt, so
+    /// transactions are chained back to back. Behind a direct asynchronous
+    /// transfer the queue waits for its completion.
+    func startNextTransaction() {
+        while !isBusy, let transaction = transactionQueue.pop() {
+            let device = transaction.device
+            do {
+                try select(device)
+                device.chipSelect.set(.low)
+                let completion: CompletionHandler = { [unowned self] error in
+                    device.chipSelect.set(.high)
+                    transaction.completion?(error)
+                    self.startNextTransaction()
+                }
+                transactionActive = true
+                switch transaction.operation {
+                case let .send(buffer):
+                    try sendAsync(buffer, completion: completion)
+                case let .receive(buffer):
+                    try receiveAsync(into: buffer, completion: completion)
+                case let .transfer(tx, rx):
+                    try transferAsync(tx: tx, rx: rx, completion: completion)
+                }
+                return
+            } catch {
+                transactionActive = false
+                device.chipSelect.set(.high)
+                transaction.completion?(error)
+            }
+        }
+        transactionActive = false
+    }
+}
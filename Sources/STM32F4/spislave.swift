@@ -0,0 +1,124 @@
+import CSTM32F4
+
+extension SPI {
+    /// Called from interrupt context once the master releases NSS, with the
+    /// bytes received during the frame and the response buffer shifted out
+    /// during the next frame. Both buffers are only valid during the call.
+    public typealias MessageHandler = (_ message: UnsafeBufferPointer<UInt8>,
+                                       _ response: UnsafeMutableBufferPointer<UInt8>) -> Void
+
+    final class SlaveSession {
+        /// The longest frame accepted, in bytes.
+        let capacity: Int
+        /// Both hold `capacity` bytes plus one frame of slack, so a frame of
+        /// exactly `capacity` bytes does not complete the circular transfer.
+        let rx: UnsafeMutableBufferPointer<UInt8>
+        let tx: UnsafeMutableBufferPointer<UInt8>
+        let handler: MessageHandler
+
+        /// Set when the frame was longer than the receive buffer.
+        var overflowed = false
+        /// Set when the peripheral or a DMA stream reported an error.
+        var failed = false
+        /// Number of frames dropped because they overflowed or failed.
+        var droppedFrames = 0
+
+        init(capacity: Int, frameSize: Int, handler: @escaping MessageHandler) {
+            self.capacity = capacity
+            rx = UnsafeMutableBufferPointer.allocate(capacity: capacity + frameSize)
+            rx.initialize(repeating: 0)
+            tx = UnsafeMutableBufferPointer.allocate(capacity: capacity + frameSize)
+            tx.initialize(repeating: 0xFF)
+            self.handler = handler
+        }
+
+        deinit {
+            rx.deallocate()
+            tx.deallocate()
+        }
+    }
+
+    /// Starts answering a master. The bus must have been configured in
+    /// `.slave` mode with a `.hardInput` slave select.
+    ///
+    /// Both DMA streams run in circular mode over `bufferSize` bytes and one
+    /// spare frame, so the CPU is only involved once per frame, when NSS
+    /// rises: the streams are rewound, `handler` receives the frame and may
+    /// rewrite the response, which is preloaded for the next frame. Frames
+    /// longer than `bufferSize` complete the circular transfer and are
+    /// dropped. The master must leave enough time between frames for the
+    /// handler to run.
+    public func startSlave(bufferSize: Int,
+                           response: UnsafeBufferPointer<UInt8>? = nil,
+                           handler: @escaping MessageHandler) throws {
+        guard let slaveSelect = slaveSelectInput else {
+            preconditionFailure("SPI.startSlave requires a slave configuration with a hardware NSS input")
+        }
+        let frameSize = dataSize == .eightBits ? 1 : 2
+        precondition(bufferSize > 0 && bufferSize + frameSize <= Int(UInt16.max), "invalid SPI slave buffer size")
+        precondition(bufferSize % frameSize == 0, "SPI slave buffer must hold whole frames")
+
+        stopSlave()
+        let session = SlaveSession(capacity: bufferSize, frameSize: frameSize, handler: handler)
+        if let response = response, let source = response.baseAddress {
+            session.tx.baseAddress!.assign(from: source, count: min(response.count, bufferSize))
+        }
+        try configureDMA(mode: .circular)
+        try armSlave(session)
+        slaveSession = session
+        slaveSelect.attachInterrupt(edge: .rising) { [unowned self] in
+            self.slaveFrameEnded()
+        }
+    }
+
+    /// Stops answering the master. Frames in progress are discarded.
+    public func stopSlave() {
+        guard slaveSession != nil else { return }
+        slaveSession = nil
+        HAL_SPI_DMAStop(handle)
+    }
+
+    /// Number of frames dropped since `startSlave`, because they were
+    /// longer than the buffer or a transfer error occurred.
+    public var droppedSlaveFrames: Int {
+        return slaveSession?.droppedFrames ?? 0
+    }
+
+    private func armSlave(_ session: SlaveSession) throws {
+        try _HAL_SPI_TransmitReceive_DMA(handle, session.tx.baseAddress, session.rx.baseAddress,
+                                         frameCount(session.rx.count)).throwOnFailure()
+    }
+
+    /// NSS rising edge: the master finished a frame.
+    private func slaveFrameEnded() {
+        guard let session = slaveSession else { return }
+        let itemSize = dataSize == .eightBits ? 1 : 2
+        let received = session.rx.count - rxDMA.stream.remaining * itemSize
+        guard received > 0 || session.overflowed || session.failed else {
+            // NSS toggled without clocks, the preloaded response is still aligned
+            return
+        }
+
+        HAL_SPI_DMAStop(handle)
+        // disabling the peripheral does not drop the byte already preloaded
+        // into DR, only a reset realigns the response with the next frame
+        resetPeripheral()
+        HAL_SPI_Init(handle)
+
+        if session.overflowed || session.failed {
+            session.droppedFrames += 1
+        } else {
+            session.handler(UnsafeBufferPointer(rebasing: session.rx[..<received]),
+                            UnsafeMutableBufferPointer(rebasing: session.tx[..<session.capacity]))
+        }
+        session.overflowed = false
+        session.failed = false
+
+        do {
+            try armSlave(session)
+        } catch {
+            // retried on the next NSS edge
+            session.failed = true
+        }
+    }
+}
@@ -0,0 +1,315 @@
+import CSTM32F4
+import STM32F4Support
+
+extension STM32F4 {
+    public var tim1: TIM {
+        return getOrCreateResource(identifier: "tim_1",
+                                   create: TIM(address: TIM1_BASE,
+                                               enableClock: m__HAL_RCC_TIM1_CLK_ENABLE,
+                                               clockFrequencyGetter: HAL_RCC_GetPCLK2Freq,
+                                               updateDMA: .tim1Up))
+    }
+
+    public var tim8: TIM {
+        return getOrCreateResource(identifier: "tim_8",
+                                   create: TIM(address: TIM8_BASE,
+                                               enableClock: m__HAL_RCC_TIM8_CLK_ENABLE,
+                                               clockFrequencyGetter: HAL_RCC_GetPCLK2Freq,
+                                               updateDMA: .tim8Up))
+    }
+
+    /// A general purpose timer with a 32 bit counter, suited as a free
+    /// running time base.
+    public var tim2: TIM {
+        return getOrCreateResource(identifier: "tim_2",
+                                   create: TIM(address: TIM2_BASE,
+                                               enableClock: m__HAL_RCC_TIM2_CLK_ENABLE,
+                                               clockFrequencyGetter: HAL_RCC_GetPCLK1Freq,
+                                               interruptNumber: TIM2_IRQn))
+    }
+
+    /// A basic timer, suited as a periodic tick.
+    public var tim6: TIM {
+        return getOrCreateResource(identifier: "tim_6",
+                                   create: TIM(address: TIM6_BASE,
+                                               enableClock: m__HAL_RCC_TIM6_CLK_ENABLE,
+                                               clockFrequencyGetter: HAL_RCC_GetPCLK1Freq,
+                                               interruptNumber: TIM6_DAC_IRQn))
+    }
+
+    /// A basic timer, suited as a periodic tick.
+    public var tim7: TIM {
+        return getOrCreateResource(identifier: "tim_7",
+                                   create: TIM(address: TIM7_BASE,
+                                               enableClock: m__HAL_RCC_TIM7_CLK_ENABLE,
+                                               clockFrequencyGetter: HAL_RCC_GetPCLK1Freq,
+                                               interruptNumber: TIM7_IRQn))
+    }
+}
+
+/// A general purpose or advanced timer, used as a time base.
+public final class TIM {
+    var handle: UnsafeMutablePointer<TIM_HandleTypeDef>
+
+    let address: UInt32
+    let enableClock: () -> Void
+    let getClockFrequency: () -> UInt32
+
+    /// The DMA request raised on each update event, if the timer has one
+    /// usable for memory-to-GPIO transfers.
+    let updateDMA: DMA.Request?
+
+    /// The update interrupt, if the timer has its own vector.
+    let interruptNumber: IRQn_Type?
+
+    /// Called from interrupt context on every overflow.
+    public typealias UpdateHandler = () -> Void
+
+    fileprivate var updateHandler: UpdateHandler?
+
+    /// Called from interrupt context when the counter matches the compare
+    /// value of channel 1.
+    public typealias CompareHandler = () -> Void
+
+    fileprivate var compareHandler: CompareHandler?
+
+    /// The frequency requested from `configure`.
+    private var frequency: Int?
+    /// The counting frequency requested from `configure(tickFrequency:)`.
+    private var tickFrequency: Int?
+
+    fileprivate init(address: UInt32,
+                     enableClock: @escaping () -> Void,
+                     clockFrequencyGetter: @escaping () -> UInt32,
+                     updateDMA: DMA.Request? = nil,
+                     interruptNumber: IRQn_Type? = nil) {
+        handle = UnsafeMutablePointer<TIM_HandleTypeDef>.allocate(capacity: 1)
+        handle.initialize(to: TIM_HandleTypeDef())
+        handle.pointee.Instance = UnsafeMutablePointer<TIM_TypeDef>(bitPattern: UInt(address))!
+        self.address = address
+        self.enableClock = enableClock
+        getClockFrequency = clockFrequencyGetter
+        self.updateDMA = updateDMA
+        self.interruptNumber = interruptNumber
+        instances.append(self)
+        Clock.observers.append(self)
+    }
+
+    deinit {
+        handle.deallocate()
+    }
+
+    /// The frequency the prescaler is fed with. Timers on an APB bus with a
+    /// prescaler other than 1 run at twice the bus clock.
+    public var clockFrequency: Int {
+        let busFrequency = getClockFrequency()
+        return Int(busFrequency == HAL_RCC_GetHCLKFreq() ? busFrequency : 2 * busFrequency)
+    }
+
+    /// The width of the counter: TIM2 and TIM5 count to 2^32, the others to
+    /// 2^16.
+    public var counterBits: Int {
+        return address == TIM2_BASE || address == TIM5_BASE ? 32 : 16
+    }
+
+    public var counter: UInt32 {
+        return handle.pointee.Instance.pointee.CNT
+    }
+
+    /// The timer is counting.
+    public var isRunning: Bool {
+        return handle.pointee.Instance.pointee.CR1 & TIM_CR1_CEN != 0
+    }
+
+    /// Sets up the counter to overflow `frequency` times per second and
+    /// returns the frequency actually reached. The timer is left stopped.
+    @discardableResult
+    public func configure(frequency: Int) throws -> Int {
+        let (prescaler, period) = dividers(for: frequency)
+
+        enableClock()
+        var initInfo = TIM_Base_InitTypeDef()
+        initInfo.Prescaler = prescaler
+        initInfo.CounterMode = TIM_COUNTERMODE_UP
+        initInfo.Period = period
+        initInfo.ClockDivision = TIM_CLOCKDIVISION_DIV1
+        initInfo.RepetitionCounter = 0
+        handle.pointee.Init = initInfo
+        handle.pointee.State = HAL_TIM_STATE_RESET
+        try HAL_TIM_Base_Init(handle).throwOnFailure()
+        self.frequency = frequency
+        tickFrequency = nil
+        return clockFrequency / Int((prescaler + 1) * (period + 1))
+    }
+
+    /// Sets up the counter to count `tickFrequency` times per second over
+    /// its full range, and returns the frequency actually reached. The timer
+    /// is left stopped, with no update pending.
+    @discardableResult
+    public func configure(tickFrequency: Int) throws -> Int {
+        let prescaler = self.prescaler(for: tickFrequency)
+
+        enableClock()
+        var initInfo = TIM_Base_InitTypeDef()
+        initInfo.Prescaler = prescaler
+        initInfo.CounterMode = TIM_COUNTERMODE_UP
+        initInfo.Period = counterBits == 32 ? 0xFFFF_FFFF : 0xFFFF
+        initInfo.ClockDivision = TIM_CLOCKDIVISION_DIV1
+        initInfo.RepetitionCounter = 0
+        handle.pointee.Init = initInfo
+        handle.pointee.State = HAL_TIM_STATE_RESET
+        try HAL_TIM_Base_Init(handle).throwOnFailure()
+
+        let registers = handle.pointee.Instance!
+        // only overflows are update events, not the UG used to load a new
+        // prescaler
+        registers.pointee.CR1 |= TIM_CR1_URS
+        registers.pointee.SR = ~TIM_SR_UIF
+        frequency = nil
+        self.tickFrequency = tickFrequency
+        return clockFrequency / Int(prescaler + 1)
+    }
+
+    private func dividers(for frequency: Int) -> (prescaler: UInt32, period: UInt32) {
+        let clock = clockFrequency
+        precondition(frequency > 0 && frequency <= clock, "invalid timer frequency")
+        let ticks = clock / frequency
+        // the smallest prescaler gives the finest period resolution
+        let prescaler = (ticks - 1) / 0x10000
+        let period = ticks / (prescaler + 1) - 1
+        return (UInt32(prescaler), UInt32(period))
+    }
+
+    private func prescaler(for tickFrequency: Int) -> UInt32 {
+        let clock = clockFrequency
+        precondition(tickFrequency > 0 && clock / tickFrequency <= 0x10000, "invalid timer tick frequency")
+        return UInt32(max(clock / tickFrequency, 1) - 1)
+    }
+
+    public func start() throws {
+        try HAL_TIM_Base_Start(handle).throwOnFailure()
+    }
+
+    /// Starts counting and calls `handler` from interrupt context on every
+    /// overflow.
+    public func start(handler: @escaping UpdateHandler) throws {
+        guard let interruptNumber = interruptNumber else {
+            preconditionFailure("the timer has no update interrupt")
+        }
+        updateHandler = handler
+        HAL_NVIC_SetPriority(interruptNumber, 3, 0)
+        HAL_NVIC_EnableIRQ(interruptNumber)
+        try HAL_TIM_Base_Start_IT(handle).throwOnFailure()
+    }
+
+    public func stop() throws {
+        stopCompare()
+        if updateHandler != nil {
+            updateHandler = nil
+            try HAL_TIM_Base_Stop_IT(handle).throwOnFailure()
+        } else {
+            try HAL_TIM_Base_Stop(handle).throwOnFailure()
+        }
+    }
+
+    /// Calls `handler` from interrupt context each time the counter reaches
+    /// the value set with `setCompare`. The update interrupt must be enabled
+    /// with `start(handler:)`, as both share the timer's vector.
+    public func startCompare(handler: @escaping CompareHandler) {
+        let registers = handle.pointee.Instance!
+        compareHandler = handler
+        // channel 1 as a frozen output: the match only sets CC1IF, and CCR1
+        // writes apply at once
+        registers.pointee.CCMR1 &= ~(TIM_CCMR1_CC1S | TIM_CCMR1_OC1M | TIM_CCMR1_OC1PE)
+        registers.pointee.SR = ~TIM_SR_CC1IF
+        registers.pointee.DIER |= TIM_DIER_CC1IE
+    }
+
+    public func stopCompare() {
+        handle.pointee.Instance.pointee.DIER &= ~TIM_DIER_CC1IE
+        compareHandler = nil
+    }
+
+    /// Sets the counter value at which the compare handler runs next, and
+    /// discards a match of the previous value not yet served. A value the
+    /// counter has already passed matches only after it wraps around.
+    public func setCompare(_ value: UInt32) {
+        let registers = handle.pointee.Instance!
+        registers.pointee.CCR1 = value
+        registers.pointee.SR = ~TIM_SR_CC1IF
+    }
+
+    /// Runs the compare handler as soon as interrupts allow.
+    public func triggerCompare() {
+        handle.pointee.Instance.pointee.EGR = TIM_EGR_CC1G
+    }
+
+    /// The counter has overflowed and the update interrupt has not been
+    /// served yet.
+    var isUpdatePending: Bool {
+        return handle.pointee.Instance.pointee.SR & TIM_SR_UIF != 0
+    }
+
+    /// Raises the update DMA request on every overflow.
+    func enableUpdateDMA(_ enable: Bool) {
+        if enable {
+            handle.pointee.Instance.pointee.DIER |= TIM_DIER_UDE
+        } else {
+            handle.pointee.Instance.pointee.DIER &= ~TIM_DIER_UDE
+        }
+    }
+}
+
+extension TIM: ClockObserver {
+    /// Keeps the overflow frequency. PSC is always preloaded and ARR is
+    /// made so, so the new prescaler and period apply together from the
+    /// next update event. A free running counter can wait for no overflow:
+    /// its prescaler is loaded at once, and the count kept.
+    public func clockDidChange(to tree: ClockTree) {
+        if let tickFrequency = tickFrequency {
+            let prescaler = self.prescaler(for: tickFrequency)
+            handle.pointee.Init.Prescaler = prescaler
+            let registers = handle.pointee.Instance!
+            registers.pointee.PSC = prescaler
+            let count = registers.pointee.CNT
+            registers.pointee.EGR = TIM_EGR_UG
+            registers.pointee.CNT = count
+            return
+        }
+        guard let frequency = frequency else { return }
+        let (prescaler, period) = dividers(for: frequency)
+        handle.pointee.Init.Prescaler = prescaler
+        handle.pointee.Init.Period = period
+        let registers = handle.pointee.Instance!
+        // without ARPE a new ARR below the count would be overrun until
+        // the counter wraps, and would run on the old prescaler meanwhile
+        registers.pointee.CR1 |= TIM_CR1_ARPE
+        registers.pointee.PSC = prescaler
+        registers.pointee.ARR = period
+    }
+}
+
+extension TIM {
+    static func handleInterrupt(address: UInt32) {
+        for tim in instances where tim.address == address {
+            HAL_TIM_IRQHandler(tim.handle)
+        }
+    }
+}
+
+private var instances: [TIM] = []
+
+@_silgen_name("HAL_TIM_PeriodElapsedCallback")
+internal func HAL_TIM_PeriodElapsedCallback(htim: UnsafeMutablePointer<TIM_HandleTypeDef>) {
+    for tim in instances where tim.handle == htim {
+        tim.updateHandler?()
+    }
+}
+
+@_silgen_name("HAL_TIM_OC_DelayElapsedCallback")
+internal func HAL_TIM_OC_DelayElapsedCallback(htim: UnsafeMutablePointer<TIM_HandleTypeDef>) {
+    guard htim.pointee.Channel == HAL_TIM_ACTIVE_CHANNEL_1 else { return }
+    for tim in instances where tim.handle == htim {
+        tim.compareHandler?()
+    }
+}
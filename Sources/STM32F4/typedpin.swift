@@ -0,0 +1,140 @@
+import CSTM32F4
+import Hardware
+
+/// A GPIO port known at compile time.
+public protocol GPIOPort {
+    static var address: UInt32 { get }
+    static var peripheral: GPIO.Peripheral { get }
+}
+
+extension GPIO {
+    public enum PortA: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOA_BASE }
+        public static var peripheral: Peripheral { return .A }
+    }
+
+    public enum PortB: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOB_BASE }
+        public static var peripheral: Peripheral { return .B }
+    }
+
+    public enum PortC: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOC_BASE }
+        public static var peripheral: Peripheral { return .C }
+    }
+
+    public enum PortD: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOD_BASE }
+        public static var peripheral: Peripheral { return .D }
+    }
+
+    public enum PortE: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOE_BASE }
+        public static var peripheral: Peripheral { return .E }
+    }
+
+    public enum PortF: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOF_BASE }
+        public static var peripheral: Peripheral { return .F }
+    }
+
+    public enum PortG: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOG_BASE }
+        public static var peripheral: Peripheral { return .G }
+    }
+
+    public enum PortH: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOH_BASE }
+        public static var peripheral: Peripheral { return .H }
+    }
+
+    public enum PortI: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOI_BASE }
+        public static var peripheral: Peripheral { return .I }
+    }
+
+    public enum PortJ: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOJ_BASE }
+        public static var peripheral: Peripheral { return .J }
+    }
+
+    public enum PortK: GPIOPort {
+        @inlinable public static var address: UInt32 { return GPIOK_BASE }
+        public static var peripheral: Peripheral { return .K }
+    }
+
+    /// A pin whose port is part of its type. Unlike `Pin`, which goes
+    /// through the HAL and a class instance, reads and writes inline to a
+    /// single IDR load or BSRR store once the pin number is a constant:
+    ///
+    ///     let led = GPIO.TypedPin<GPIO.PortG>(13, mode: .output)
+    ///     led.set(.high)
+    ///
+    /// Configuration still goes through the shared `Pin` object.
+    public struct TypedPin<Port: GPIOPort> {
+        public let number: Int
+
+        @usableFromInline
+        let mask: UInt32
+
+        @inlinable
+        public init(_ number: Int, mode: Pin.Mode? = nil) {
+            precondition(number >= 0 && number < 16, "invalid pin number")
+            self.number = number
+            mask = 1 << UInt32(number)
+            if let mode = mode {
+                pin.configure(mode)
+            }
+        }
+
+        /// The pin object used for configuration and interrupts.
+        public var pin: Pin {
+            return Port.peripheral.pin(number: number)
+        }
+
+        @inlinable
+        var registers: UnsafeMutablePointer<GPIO_TypeDef> {
+            return UnsafeMutablePointer<GPIO_TypeDef>(bitPattern: UInt(Port.address))!
+        }
+
+        @inlinable
+        public func set() {
+            LL_GPIO_SetOutputPin(registers, mask)
+        }
+
+        @inlinable
+        public func clear() {
+            LL_GPIO_ResetOutputPin(registers, mask)
+        }
+
+        @inlinable
+        public var isSet: Bool {
+            return LL_GPIO_ReadInputPort(registers) & mask != 0
+        }
+    }
+}
+
+extension GPIO.TypedPin: DigitalIn {
+    @inlinable
+    public func get() -> PinState {
+        return isSet ? .high : .low
+    }
+}
+
+extension GPIO.TypedPin: DigitalOut {
+    @inlinable
+    public func set(_ value: PinState) {
+        // BSRR takes set bits in the low half and reset bits in the high half
+        LL_GPIO_SetOutputPin(registers, value == .high ? mask : mask << 16)
+    }
+}
+
+extension GPIO.TypedPin: ToggleableDigitalOut {
+    @inlinable
+    public func toggle() {
+        // a single BSRR write, so pins of the same port changed from an
+        // interrupt are not overwritten as with a read-modify-write of ODR
+        let output = LL_GPIO_ReadOutputPort(registers)
+        LL_GPIO_SetOutputPin(registers, (output & mask) << 16 | (~output & mask))
+    }
+}
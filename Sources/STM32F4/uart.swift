@@ -1,82 +1,461 @@
 import CSTM32F4
 import Hardware
+import STM32F4Support
 
 extension STM32F4 {
+    public var uart1: UART {
+        getOrCreateResource(identifier: "uart_1",
+                            create: UART(address: USART1_BASE,
+                                         enableClock: m__HAL_RCC_USART1_CLK_ENABLE,
+                                         clockFrequencyGetter: HAL_RCC_GetPCLK2Freq,
+                                         interruptNumber: USART1_IRQn,
+                                         pins: UART.Pins(rx: gpio.pin(peripheral: .A, number: 10),
+                                                         tx: gpio.pin(peripheral: .A, number: 9),
+                                                         cts: gpio.pin(peripheral: .A, number: 11),
+                                                         rts: gpio.pin(peripheral: .A, number: 12)),
+                                         txDMA: .usart1Tx,
+                                         rxDMA: .usart1Rx))
+    }
+
     public var uart3: UART {
         getOrCreateResource(identifier: "uart_3",
                             create: UART(address: USART3_BASE,
                                          enableClock: m__HAL_RCC_USART3_CLK_ENABLE,
-                                         rxPin: gpio.pin(peripheral: .D, number: 9),
-                                         txPin: gpio.pin(peripheral: .D, number: 8)))
+                                         clockFrequencyGetter: HAL_RCC_GetPCLK1Freq,
+                                         interruptNumber: USART3_IRQn,
+                                         pins: UART.Pins(rx: gpio.pin(peripheral: .D, number: 9),
+                                                         tx: gpio.pin(peripheral: .D, number: 8),
+                                                         cts: gpio.pin(peripheral: .D, number: 11),
+                                                         rts: gpio.pin(peripheral: .D, number: 12)),
+                                         txDMA: .usart3Tx,
+                                         rxDMA: .usart3Rx))
+    }
+
+    public var uart6: UART {
+        getOrCreateResource(identifier: "uart_6",
+                            create: UART(address: USART6_BASE,
+                                         enableClock: m__HAL_RCC_USART6_CLK_ENABLE,
+                                         clockFrequencyGetter: HAL_RCC_GetPCLK2Freq,
+                                         interruptNumber: USART6_IRQn,
+                                         pins: UART.Pins(rx: gpio.pin(peripheral: .C, number: 7),
+                                                         tx: gpio.pin(peripheral: .C, number: 6),
+                                                         cts: gpio.pin(peripheral: .G, number: 13),
+                                                         rts: gpio.pin(peripheral: .G, number: 12)),
+                                         txDMA: .usart6Tx,
+                                         rxDMA: .usart6Rx))
     }
 }
 
 public final class UART {
     var handle: UnsafeMutablePointer<UART_HandleTypeDef>
+    let address: UInt32
     let enableClock: () -> Void
-    let rxPin: GPIO.Pin
-    let txPin: GPIO.Pin
+    let getClockFrequency: () -> UInt32
+    let interruptNumber: IRQn_Type
+    let defaultPins: Pins
+    let txDMA: DMA.Request
+    let rxDMA: DMA.Request
+
+    private var transmitBuffer: DoubleBuffer?
+    private var receiveBuffer: RingBuffer<UInt8>?
+    private var receiveDMABuffer: UnsafeMutableBufferPointer<UInt8>?
+    private var receiveDMAPosition = 0
+    private var receiveHandler: ReceiveHandler?
+
+    /// Number of received bytes dropped because the receive buffer was full.
+    public private(set) var receiveOverruns = 0
+
+    private static let transmitTimeoutMs: UInt32 = 5000
 
     fileprivate init(address: UInt32,
                      enableClock: @escaping () -> Void,
-                     rxPin: GPIO.Pin,
-                     txPin: GPIO.Pin) {
+                     clockFrequencyGetter: @escaping () -> UInt32,
+                     interruptNumber: IRQn_Type,
+                     pins: Pins,
+                     txDMA: DMA.Request,
+                     rxDMA: DMA.Request) {
         handle = UnsafeMutablePointer<UART_HandleTypeDef>.allocate(capacity: 1)
         handle.pointee = UART_HandleTypeDef()
         handle.pointee.Instance = UnsafeMutablePointer<USART_TypeDef>(bitPattern: UInt(address))
+        self.address = address
         self.enableClock = enableClock
-        self.txPin = txPin
-        self.rxPin = rxPin
+        getClockFrequency = clockFrequencyGetter
+        self.interruptNumber = interruptNumber
+        defaultPins = pins
+        self.txDMA = txDMA
+        self.rxDMA = rxDMA
+        instances.append(self)
+        Clock.observers.append(self)
     }
 
     deinit {
+        txDMA.stream.release(from: self)
+        rxDMA.stream.release(from: self)
+        receiveDMABuffer?.deallocate()
         self.handle.deallocate()
     }
 
+    /// The pins carrying the UART's signals. Every pin must be routable to
+    /// the instance, see `PinMux`.
+    public struct Pins {
+        public var rx: GPIO.Pin
+        public var tx: GPIO.Pin
+        public var cts: GPIO.Pin?
+        public var rts: GPIO.Pin?
+
+        public init(rx: GPIO.Pin, tx: GPIO.Pin, cts: GPIO.Pin? = nil, rts: GPIO.Pin? = nil) {
+            self.rx = rx
+            self.tx = tx
+            self.cts = cts
+            self.rts = rts
+        }
+    }
+
     public enum Parity {
         case none
         case even
         case odd
     }
 
+    public enum WordLength {
+        case eightBits
+        case nineBits
+    }
+
+    public enum StopBits {
+        case one
+        case two
+    }
+
+    public enum FlowControl {
+        case none
+        case rts
+        case cts
+        case rtsCts
+    }
+
+    public enum Oversampling {
+        /// More tolerant to clock deviations, baud rate up to f_PCLK / 16.
+        case by16
+        /// Baud rate up to f_PCLK / 8, e.g. 10.5 Mbaud on the APB2 USARTs.
+        case by8
+    }
+
+    public enum TransmitMode {
+        /// `write` polls the peripheral until the whole buffer is sent.
+        case blocking
+        /// `write` copies the data into one of two staging buffers of
+        /// `bufferSize` bytes and returns; the DMA drains them in the background.
+        case dma(bufferSize: Int)
+    }
+
+    public enum ReceiveMode {
+        /// `read` polls the peripheral.
+        case blocking
+        /// The RXNE interrupt pushes every byte into a ring buffer of
+        /// `bufferSize` bytes which `read` drains.
+        case interrupt(bufferSize: Int)
+        /// The DMA fills a circular buffer of `bufferSize` bytes without any
+        /// per-byte interrupt. `handler` is called from interrupt context with
+        /// slices of that buffer whenever the line goes idle (end of frame) or
+        /// the DMA crosses the buffer's half or end. `read` is not available.
+        case circularDMA(bufferSize: Int, handler: ReceiveHandler)
+    }
+
+    /// Receives a slice of the DMA buffer and whether the slice ends a frame.
+    /// The slice is only valid for the duration of the call.
+    public typealias ReceiveHandler = (UnsafeBufferPointer<UInt8>, _ endOfFrame: Bool) -> Void
+
     public struct Configuration {
         var baudrate: Int
         var parity: Parity
+        var wordLength: WordLength
+        var stopBits: StopBits
+        var flowControl: FlowControl
+        var oversampling: Oversampling
+        var transmitMode: TransmitMode
+        var receiveMode: ReceiveMode
+        var pins: Pins?
 
-        public init(baudrate: Int = 9600, parity: Parity = .none) {
+        /// `pins` defaults to the instance's board wiring.
+        public init(baudrate: Int = 9600,
+                    parity: Parity = .none,
+                    wordLength: WordLength = .eightBits,
+                    stopBits: StopBits = .one,
+                    flowControl: FlowControl = .none,
+                    oversampling: Oversampling = .by16,
+                    transmitMode: TransmitMode = .blocking,
+                    receiveMode: ReceiveMode = .blocking,
+                    pins: Pins? = nil) {
             self.baudrate = baudrate
             self.parity = parity
+            self.wordLength = wordLength
+            self.stopBits = stopBits
+            self.flowControl = flowControl
+            self.oversampling = oversampling
+            self.transmitMode = transmitMode
+            self.receiveMode = receiveMode
+            self.pins = pins
         }
     }
 
     public func configure(_ config: Configuration) throws {
+        // stop transfers of a previous configuration
+        if handle.pointee.gState != HAL_UART_STATE_RESET {
+            HAL_UART_Abort(handle)
+        }
         // enable peripheral's clock
         enableClock()
         // configure gpio
-        let pinConfig = GPIO_InitTypeDef(Pin: 0,
-                                         Mode: UInt32(GPIO_MODE_AF_PP),
-                                         Pull: GPIO_PULLUP,
-                                         Speed: GPIO_SPEED_FREQ_VERY_HIGH,
-                                         Alternate: UInt32(GPIO_AF7_USART3))
-        rxPin.configure(.manual(hal: pinConfig))
-        txPin.configure(.manual(hal: pinConfig))
+        let pins = config.pins ?? defaultPins
+        func connect(_ pin: GPIO.Pin, as signal: PinMux.Signal) {
+            let pinConfig = GPIO_InitTypeDef(Pin: 0,
+                                             Mode: UInt32(GPIO_MODE_AF_PP),
+                                             Pull: GPIO_PULLUP,
+                                             Speed: GPIO_SPEED_FREQ_VERY_HIGH,
+                                             Alternate: PinMux.alternate(for: pin, instance: address, signal: signal))
+            pin.configure(.manual(hal: pinConfig))
+        }
+        connect(pins.rx, as: .uartRX)
+        connect(pins.tx, as: .uartTX)
+        if config.flowControl == .cts || config.flowControl == .rtsCts {
+            guard let cts = pins.cts else { preconditionFailure("CTS flow control requires a CTS pin") }
+            connect(cts, as: .uartCTS)
+        }
+        if config.flowControl == .rts || config.flowControl == .rtsCts {
+            guard let rts = pins.rts else { preconditionFailure("RTS flow control requires an RTS pin") }
+            connect(rts, as: .uartRTS)
+        }
         // prepare init struct
         handle.pointee.Init = config.toHAL()
         // init the peripheral
         try HAL_UART_Init(handle).throwOnFailure()
+        // the paths below claim the streams they use again
+        txDMA.stream.release(from: self)
+        rxDMA.stream.release(from: self)
+        // set up the transmit path
+        switch config.transmitMode {
+        case .blocking:
+            handle.pointee.hdmatx = nil
+            transmitBuffer = nil
+        case let .dma(bufferSize):
+            try txDMA.stream.configure(for: self, channel: txDMA.channel, direction: .memoryToPeripheral)
+            txDMA.stream.link(to: handle, for: self)
+            handle.pointee.hdmatx = txDMA.stream.handle
+            transmitBuffer = DoubleBuffer(capacity: bufferSize)
+        }
+        // set up the receive path
+        receiveBuffer = nil
+        receiveDMABuffer?.deallocate()
+        receiveDMABuffer = nil
+        receiveHandler = nil
+        handle.pointee.hdmarx = nil
+        switch config.receiveMode {
+        case .blocking:
+            break
+        case let .interrupt(bufferSize):
+            receiveBuffer = RingBuffer(capacity: bufferSize)
+            handle.pointee.Instance.pointee.CR1 |= USART_CR1_RXNEIE
+        case let .circularDMA(bufferSize, handler):
+            precondition(bufferSize > 0 && bufferSize <= Int(UInt16.max), "invalid buffer size")
+            try rxDMA.stream.configure(for: self, channel: rxDMA.channel, direction: .peripheralToMemory,
+                                       mode: .circular, priority: .high)
+            rxDMA.stream.link(to: handle, for: self)
+            handle.pointee.hdmarx = rxDMA.stream.handle
+            let buffer = UnsafeMutableBufferPointer<UInt8>.allocate(capacity: bufferSize)
+            buffer.initialize(repeating: 0)
+            receiveDMABuffer = buffer
+            receiveHandler = handler
+            try startReceiveDMA()
+        }
+
+        HAL_NVIC_SetPriority(interruptNumber, 3, 0)
+        HAL_NVIC_EnableIRQ(interruptNumber)
+    }
+
+    /// Changes the baud rate of a configured UART by reprogramming BRR,
+    /// without going through `HAL_UART_Init`. Waits for the transmission
+    /// in progress to finish first.
+    public func setBaudrate(_ baudrate: Int) throws {
+        try waitForTransmissionComplete()
+        handle.pointee.Init.BaudRate = UInt32(baudrate)
+        writeBRR()
+    }
+
+    private func waitForTransmissionComplete() throws {
+        let registers = handle.pointee.Instance!
+        let start = HAL_GetTick()
+        while registers.pointee.CR1 & USART_CR1_TE != 0, registers.pointee.SR & USART_SR_TC == 0 {
+            if HAL_GetTick() &- start > UART.transmitTimeoutMs {
+                throw STM32F4Error.timeout
+            }
+        }
+    }
+
+    /// Programs BRR for the configured baud rate from the current bus clock.
+    private func writeBRR() {
+        let registers = handle.pointee.Instance!
+        let brr = UART.computeBRR(peripheralClockFrequency: getClockFrequency(),
+                                  baudrate: handle.pointee.Init.BaudRate,
+                                  oversampling: handle.pointee.Init.OverSampling)
+        registers.pointee.CR1 &= ~USART_CR1_UE
+        registers.pointee.BRR = brr
+        registers.pointee.CR1 |= USART_CR1_UE
+    }
+
+    static func computeBRR(peripheralClockFrequency pclk: UInt32, baudrate: UInt32, oversampling: UInt32) -> UInt32 {
+        if oversampling == UART_OVERSAMPLING_8 {
+            return mUART_BRR_SAMPLING8(pclk, baudrate)
+        } else {
+            return mUART_BRR_SAMPLING16(pclk, baudrate)
+        }
+    }
+
+    /// Waits until all data staged by `write` has been handed to the wire.
+    public func flush() throws {
+        guard let transmitBuffer = transmitBuffer else { return }
+        let start = HAL_GetTick()
+        while !transmitBuffer.isIdle {
+            if HAL_GetTick() &- start > UART.transmitTimeoutMs {
+                throw STM32F4Error.timeout
+            }
+        }
+    }
+
+    /// Starts a DMA transfer of the staged data if the DMA is idle.
+    /// Must be called with interrupts disabled or from the UART interrupt.
+    private func startTransmitDMA() throws {
+        guard let transmitBuffer = transmitBuffer, let region = transmitBuffer.swap() else { return }
+        do {
+            try _HAL_UART_Transmit_DMA(handle, region.baseAddress, UInt16(region.count))
+                .throwOnFailure()
+        } catch {
+            transmitBuffer.drainCompleted()
+            throw error
+        }
+    }
+
+    fileprivate func transmitCompleted() {
+        guard let transmitBuffer = transmitBuffer else { return }
+        transmitBuffer.drainCompleted()
+        try? startTransmitDMA()
+    }
+
+    private func startReceiveDMA() throws {
+        guard let buffer = receiveDMABuffer else { return }
+        receiveDMAPosition = 0
+        try HAL_UART_Receive_DMA(handle, buffer.baseAddress, UInt16(buffer.count))
+            .throwOnFailure()
+        handle.pointee.Instance.pointee.CR1 |= USART_CR1_IDLEIE
+    }
+
+    /// Hands the bytes the DMA wrote since the last call to the receive
+    /// handler. Deriving the position from NDTR keeps this idempotent across
+    /// the IDLE, half-transfer and transfer-complete events.
+    private func receiveDMAProgress(endOfFrame: Bool) {
+        guard let buffer = receiveDMABuffer, let handler = receiveHandler else { return }
+        var position = buffer.count - rxDMA.stream.remaining
+        if position == buffer.count {
+            position = 0
+        }
+        let start = receiveDMAPosition
+        if position > start {
+            handler(UnsafeBufferPointer(rebasing: buffer[start ..< position]), endOfFrame)
+        } else if position < start {
+            // the DMA wrapped around since the last call
+            handler(UnsafeBufferPointer(rebasing: buffer[start...]), endOfFrame && position == 0)
+            if position > 0 {
+                handler(UnsafeBufferPointer(rebasing: buffer[..<position]), endOfFrame)
+            }
+        }
+        receiveDMAPosition = position
+    }
 
-        HAL_NVIC_SetPriority(USART3_IRQn, 3, 0)
-        HAL_NVIC_EnableIRQ(USART3_IRQn)
+    fileprivate func receiveHalfCompleted() {
+        receiveDMAProgress(endOfFrame: false)
+    }
+
+    fileprivate func receiveCompleted() {
+        receiveDMAProgress(endOfFrame: false)
+    }
+
+    fileprivate func errorOccurred() {
+        // the HAL aborts the DMA on receive errors, restart the circular reception
+        if receiveDMABuffer != nil, handle.pointee.RxState == HAL_UART_STATE_READY {
+            try? startReceiveDMA()
+        }
+    }
+
+    fileprivate func handleInterrupt() {
+        if receiveDMABuffer != nil {
+            let registers = handle.pointee.Instance!
+            if registers.pointee.SR & USART_SR_IDLE != 0, registers.pointee.CR1 & USART_CR1_IDLEIE != 0 {
+                // reading SR followed by DR clears the IDLE flag
+                _ = registers.pointee.DR
+                receiveDMAProgress(endOfFrame: true)
+            }
+        }
+        if let receiveBuffer = receiveBuffer {
+            let registers = handle.pointee.Instance!
+            // reading SR followed by DR also clears the error flags
+            if registers.pointee.SR & USART_SR_RXNE != 0 {
+                let byte = UInt8(truncatingIfNeeded: registers.pointee.DR)
+                if !receiveBuffer.push(byte) {
+                    receiveOverruns += 1
+                }
+            }
+        }
+        HAL_UART_IRQHandler(handle)
+    }
+
+    static func handleInterrupt(address: UInt32) {
+        for uart in instances where uart.address == address {
+            uart.handleInterrupt()
+        }
     }
 }
 
+private var instances: [UART] = []
+
 extension UART: Hardware.UART {
     public func write(_ buffer: UnsafeBufferPointer<UInt8>, timeout _: TimeInterval) throws {
-        try _HAL_UART_Transmit(handle, buffer.baseAddress, UInt16(buffer.count),
-                               UInt32(5000)).throwOnFailure()
+        guard let transmitBuffer = transmitBuffer else {
+            try _HAL_UART_Transmit(handle, buffer.baseAddress, UInt16(buffer.count),
+                                   UART.transmitTimeoutMs).throwOnFailure()
+            return
+        }
+        var remaining = buffer
+        var start = HAL_GetTick()
+        while !remaining.isEmpty {
+            let written = try criticalSection { () -> Int in
+                let written = transmitBuffer.append(remaining)
+                try startTransmitDMA()
+                return written
+            }
+            if written > 0 {
+                remaining = UnsafeBufferPointer(rebasing: remaining[written...])
+                start = HAL_GetTick()
+            } else if HAL_GetTick() &- start > UART.transmitTimeoutMs {
+                throw STM32F4Error.timeout
+            }
+        }
     }
 
     public func read(into buffer: UnsafeMutableBufferPointer<UInt8>, timeout: TimeInterval) throws -> Int {
+        precondition(receiveDMABuffer == nil, "UART.read not available in circularDMA mode")
+        if let receiveBuffer = receiveBuffer {
+            var count = receiveBuffer.read(into: buffer)
+            guard timeout != 0 else { return count }
+            let start = HAL_GetTick()
+            while count < buffer.count {
+                count += receiveBuffer.read(into: UnsafeMutableBufferPointer(rebasing: buffer[count...]))
+                if HAL_GetTick() &- start > UInt32(timeout) {
+                    if count > 0 { break }
+                    throw STM32F4Error.timeout
+                }
+            }
+            return count
+        }
         if timeout == 0 {
             do {
                 try HAL_UART_Receive(handle, buffer.baseAddress, 1, 0)
@@ -93,6 +472,19 @@ extension UART: Hardware.UART {
     }
 }
 
+extension UART: ClockObserver {
+    public func clockWillChange(to tree: ClockTree) throws {
+        guard handle.pointee.gState != HAL_UART_STATE_RESET else { return }
+        try flush()
+        try waitForTransmissionComplete()
+    }
+
+    public func clockDidChange(to tree: ClockTree) {
+        guard handle.pointee.gState != HAL_UART_STATE_RESET else { return }
+        writeBRR()
+    }
+}
+
 extension UART.Parity {
     func toHAL() -> UInt32 {
         switch self {
@@ -103,14 +495,80 @@ extension UART.Parity {
     }
 }
 
+extension UART.WordLength {
+    func toHAL() -> UInt32 {
+        switch self {
+        case .eightBits: return UART_WORDLENGTH_8B
+        case .nineBits: return UART_WORDLENGTH_9B
+        }
+    }
+}
+
+extension UART.StopBits {
+    func toHAL() -> UInt32 {
+        switch self {
+        case .one: return UART_STOPBITS_1
+        case .two: return UART_STOPBITS_2
+        }
+    }
+}
+
+extension UART.FlowControl {
+    func toHAL() -> UInt32 {
+        switch self {
+        case .none: return UART_HWCONTROL_NONE
+        case .rts: return UART_HWCONTROL_RTS
+        case .cts: return UART_HWCONTROL_CTS
+        case .rtsCts: return UART_HWCONTROL_RTS_CTS
+        }
+    }
+}
+
+extension UART.Oversampling {
+    func toHAL() -> UInt32 {
+        switch self {
+        case .by16: return UART_OVERSAMPLING_16
+        case .by8: return UART_OVERSAMPLING_8
+        }
+    }
+}
+
 extension UART.Configuration {
     func toHAL() -> UART_InitTypeDef {
         UART_InitTypeDef(BaudRate: UInt32(baudrate),
-                         WordLength: UART_WORDLENGTH_8B,
-                         StopBits: UART_STOPBITS_1,
+                         WordLength: wordLength.toHAL(),
+                         StopBits: stopBits.toHAL(),
                          Parity: parity.toHAL(),
                          Mode: UART_MODE_RX | UART_MODE_TX,
-                         HwFlowCtl: UART_HWCONTROL_NONE,
-                         OverSampling: UART_OVERSAMPLING_16)
+                         HwFlowCtl: flowControl.toHAL(),
+                         OverSampling: oversampling.toHAL())
+    }
+}
+
+@_silgen_name("HAL_UART_TxCpltCallback")
+internal func HAL_UART_TxCpltCallback(huart: UnsafeMutablePointer<UART_HandleTypeDef>) {
+    for uart in instances where uart.handle == huart {
+        uart.transmitCompleted()
+    }
+}
+
+@_silgen_name("HAL_UART_RxHalfCpltCallback")
+internal func HAL_UART_RxHalfCpltCallback(huart: UnsafeMutablePointer<UART_HandleTypeDef>) {
+    for uart in instances where uart.handle == huart {
+        uart.receiveHalfCompleted()
+    }
+}
+
+@_silgen_name("HAL_UART_RxCpltCallback")
+internal func HAL_UART_RxCpltCallback(huart: UnsafeMutablePointer<UART_HandleTypeDef>) {
+    for uart in instances where uart.handle == huart {
+        uart.receiveCompleted()
+    }
+}
+
+@_silgen_name("HAL_UART_ErrorCallback")
+internal func HAL_UART_ErrorCallback(huart: UnsafeMutablePointer<UART_HandleTypeDef>) {
+    for uart in instances where uart.handle == huart {
+        uart.errorOccurred()
     }
 }
@@ -0,0 +1,272 @@
+/// The settings of the clock tree: PLL factors, bus dividers, flash wait
+/// states and regulator mode.
+///
+/// `solve` is plain integer arithmetic with no dependency on the HAL, so
+/// a clock plan can be checked on the host before it is flashed.
+public struct ClockTree: Equatable {
+    public enum Source: Equatable {
+        /// The 16 MHz internal RC oscillator.
+        case hsi
+        /// An external crystal, or an external clock when `bypass` is set
+        /// (e.g. the 8 MHz MCO of the on-board ST-LINK).
+        case hse(frequency: Int, bypass: Bool)
+
+        public var frequency: Int {
+            switch self {
+            case .hsi:
+                return 16_000_000
+            case .hse(let frequency, _):
+                return frequency
+            }
+        }
+    }
+
+    /// Supply voltage range, which sets how fast the flash can be read
+    /// without wait states.
+    public enum VoltageRange {
+        case from2V7to3V6
+        case from2V4to2V7
+        case from2V1to2V4
+        case from1V8to2V1
+
+        var hclkPerWaitState: Int {
+            switch self {
+            case .from2V7to3V6: return 30_000_000
+            case .from2V4to2V7: return 24_000_000
+            case .from2V1to2V4: return 22_000_000
+            case .from1V8to2V1: return 20_000_000
+            }
+        }
+    }
+
+    /// The maximum frequencies of a part.
+    public struct Limits: Equatable {
+        public var sysclk: Int
+        public var apb1: Int
+        public var apb2: Int
+        /// The frequency above which the regulator must be in over-drive,
+        /// or `nil` if the part has none. Without over-drive the bus limits
+        /// are lowered in the same ratio.
+        public var overDriveAbove: Int?
+
+        public init(sysclk: Int, apb1: Int, apb2: Int, overDriveAbove: Int?) {
+            self.sysclk = sysclk
+            self.apb1 = apb1
+            self.apb2 = apb2
+            self.overDriveAbove = overDriveAbove
+        }
+
+        /// F42x, F43x and F446.
+        public static let f42x = Limits(sysclk: 180_000_000, apb1: 45_000_000, apb2: 90_000_000,
+                                        overDriveAbove: 168_000_000)
+        /// F405, F407, F415 and F417.
+        public static let f40x = Limits(sysclk: 168_000_000, apb1: 42_000_000, apb2: 84_000_000,
+                                        overDriveAbove: nil)
+    }
+
+    public let source: Source
+
+    public let pllM: Int
+    public let pllN: Int
+    public let pllP: Int
+    public let pllQ: Int
+
+    /// PLLI2S factors, when an I2S clock was requested. PLLI2S shares the
+    /// input divider `pllM` with the main PLL.
+    public let pllI2SN: Int?
+    public let pllI2SR: Int?
+
+    public let ahbDivider: Int
+    public let apb1Divider: Int
+    public let apb2Divider: Int
+
+    public let flashLatency: Int
+    /// Regulator voltage scale, 1 (highest performance) to 3.
+    public let voltageScale: Int
+    public let overDrive: Bool
+
+    public var vcoInput: Int {
+        return source.frequency / pllM
+    }
+
+    public var sysclk: Int {
+        return Int(Int64(source.frequency) * Int64(pllN) / Int64(pllM * pllP))
+    }
+
+    /// The 48 MHz clock of USB OTG FS, SDIO and the RNG.
+    public var pll48: Int {
+        return Int(Int64(source.frequency) * Int64(pllN) / Int64(pllM * pllQ))
+    }
+
+    public var i2s: Int? {
+        guard let n = pllI2SN, let r = pllI2SR else { return nil }
+        return Int(Int64(source.frequency) * Int64(n) / Int64(pllM * r))
+    }
+
+    public var hclk: Int {
+        return sysclk / ahbDivider
+    }
+
+    public var pclk1: Int {
+        return hclk / apb1Divider
+    }
+
+    public var pclk2: Int {
+        return hclk / apb2Divider
+    }
+
+    private static let vcoInputRange = 1_000_000...2_000_000
+    private static let vcoOutputRange = 100_000_000...432_000_000
+    private static let pllNRange = 50...432
+    private static let pllQRange = 2...15
+    private static let pllI2SRRange = 2...7
+    private static let usbFrequency = 48_000_000
+
+    /// Finds the fastest clock tree with an HCLK of at most `hclk`, the
+    /// closest I2S clock to `i2s` and, when `usb` is set, exactly 48 MHz on
+    /// the PLL48 output. Returns `nil` if the source is out of range or no
+    /// PLL setting satisfies the constraints.
+    ///
+    /// Among equal results the highest VCO input is preferred, as it gives
+    /// the lowest PLL jitter.
+    public static func solve(source: Source, hclk target: Int, usb: Bool = false, i2s: Int? = nil,
+                             limits: Limits = .f42x, voltage: VoltageRange = .from2V7to3V6) -> ClockTree? {
+        let input = source.frequency
+        if case .hse = source, !(4_000_000...26_000_000).contains(input) {
+            return nil
+        }
+        let target = min(target, limits.sysclk)
+        guard target > 0 else { return nil }
+
+        // below the lowest PLL output, divide on the AHB bus instead
+        let minimumPLLOutput = vcoOutputRange.lowerBound / 8
+        var ahbDivider = 1
+        while target * ahbDivider < minimumPLLOutput {
+            ahbDivider = nextAHBDivider(after: ahbDivider)
+        }
+        let sysclkTarget = min(target * ahbDivider, limits.sysclk)
+
+        guard let pll = solvePLL(input: input, sysclk: sysclkTarget, usb: usb) else {
+            return nil
+        }
+
+        var pllI2S: (n: Int, r: Int)? = nil
+        if let i2sTarget = i2s {
+            pllI2S = solvePLLI2S(input: Int64(input), m: Int64(pll.m), target: Int64(i2sTarget))
+            if pllI2S == nil {
+                return nil
+            }
+        }
+
+        let hclk = pll.sysclk / ahbDivider
+        var overDrive = false
+        var apb1Limit = limits.apb1
+        var apb2Limit = limits.apb2
+        if let threshold = limits.overDriveAbove {
+            if hclk > threshold {
+                overDrive = true
+            } else {
+                apb1Limit = Int(Int64(apb1Limit) * Int64(threshold) / Int64(limits.sysclk))
+                apb2Limit = Int(Int64(apb2Limit) * Int64(threshold) / Int64(limits.sysclk))
+            }
+        }
+
+        let voltageScale: Int
+        if hclk > 144_000_000 {
+            voltageScale = 1
+        } else if hclk > 120_000_000 || limits.overDriveAbove == nil {
+            voltageScale = 2
+        } else {
+            voltageScale = 3
+        }
+
+        return ClockTree(source: source,
+                         pllM: pll.m, pllN: pll.n, pllP: pll.p, pllQ: pll.q,
+                         pllI2SN: pllI2S?.n, pllI2SR: pllI2S?.r,
+                         ahbDivider: ahbDivider,
+                         apb1Divider: apbDivider(hclk: hclk, limit: apb1Limit),
+                         apb2Divider: apbDivider(hclk: hclk, limit: apb2Limit),
+                         flashLatency: (hclk - 1) / voltage.hclkPerWaitState,
+                         voltageScale: voltageScale,
+                         overDrive: overDrive)
+    }
+
+    /// 168 MHz from the 8 MHz ST-LINK clock of the discovery boards, with
+    /// USB, as the library has always been set up.
+    public static let discovery = ClockTree.solve(source: .hse(frequency: 8_000_000, bypass: true),
+                                                  hclk: 168_000_000, usb: true)!
+
+    private static func solvePLL(input: Int, sysclk target: Int,
+                                 usb: Bool) -> (m: Int, n: Int, p: Int, q: Int, sysclk: Int)? {
+        var best: (m: Int, n: Int, p: Int, q: Int, sysclk: Int)? = nil
+        let input64 = Int64(input)
+
+        // lowest M first: highest VCO input
+        let firstM = max(2, (input + vcoInputRange.upperBound - 1) / vcoInputRange.upperBound)
+        let lastM = min(63, input / vcoInputRange.lowerBound)
+        guard firstM <= lastM else { return nil }
+
+        for m in firstM...lastM {
+            let m64 = Int64(m)
+            for p in [2, 4, 6, 8] {
+                let p64 = Int64(p)
+                if usb {
+                    // the VCO must be a multiple of 48 MHz reached with an integer N
+                    for q in pllQRange {
+                        let vco = Int64(usbFrequency * q)
+                        guard vcoOutputRange.contains(Int(vco)), vco * m64 % input64 == 0 else { continue }
+                        let n = Int(vco * m64 / input64)
+                        let sysclk = Int(vco / p64)
+                        guard pllNRange.contains(n), sysclk <= target else { continue }
+                        if sysclk > best?.sysclk ?? 0 {
+                            best = (m, n, p, q, sysclk)
+                        }
+                    }
+                } else {
+                    var n = Int(Int64(target) * m64 * p64 / input64)
+                    n = min(n, pllNRange.upperBound, Int(Int64(vcoOutputRange.upperBound) * m64 / input64))
+                    let vco = input64 * Int64(n) / m64
+                    guard pllNRange.contains(n), vcoOutputRange.contains(Int(vco)) else { continue }
+                    let sysclk = Int(vco / p64)
+                    // keep the PLL48 output at or below 48 MHz for SDIO and the RNG
+                    let q = max(pllQRange.lowerBound, Int((vco + Int64(usbFrequency) - 1) / Int64(usbFrequency)))
+                    if sysclk > best?.sysclk ?? 0 {
+                        best = (m, n, p, q, sysclk)
+                    }
+                }
+            }
+        }
+        return best
+    }
+
+    private static func solvePLLI2S(input: Int64, m: Int64, target: Int64) -> (n: Int, r: Int)? {
+        var best: (n: Int, r: Int)? = nil
+        var bestError = Int64.max
+        for n in pllNRange {
+            let vco = input * Int64(n) / m
+            guard vcoOutputRange.contains(Int(vco)) else { continue }
+            for r in pllI2SRRange {
+                let error = abs(input * Int64(n) / (m * Int64(r)) - target)
+                if error < bestError {
+                    bestError = error
+                    best = (n, r)
+                }
+            }
+        }
+        return best
+    }
+
+    private static func nextAHBDivider(after divider: Int) -> Int {
+        // there is no /32 prescaler
+        precondition(divider < 512, "HCLK below the AHB prescaler range")
+        return divider == 16 ? 64 : divider * 2
+    }
+
+    private static func apbDivider(hclk: Int, limit: Int) -> Int {
+        var divider = 1
+        while hclk / divider > limit && divider < 16 {
+            divider *= 2
+        }
+        return divider
+    }
+}
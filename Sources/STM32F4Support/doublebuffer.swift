@@ -0,0 +1,77 @@
+/// A pair of staging buffers for DMA transmission.
+///
+/// The application appends data to the *filling* half while the DMA
+/// drains the other one. Once the drain completes, the halves are swapped
+/// and the freshly filled half is handed to the DMA.
+///
+/// The type is free of any hardware dependency; callers are responsible
+/// for serializing `append` with `swap`/`drainCompleted`, which are
+/// usually called from an interrupt handler.
+public final class DoubleBuffer {
+    private let storage: UnsafeMutablePointer<UInt8>
+
+    /// Capacity of one half in bytes.
+    public let capacity: Int
+
+    /// Index (0 or 1) of the half currently being filled.
+    public private(set) var fillingIndex = 0
+
+    /// Number of bytes staged in the filling half.
+    public private(set) var filled = 0
+
+    /// Whether the other half is currently owned by the DMA.
+    public private(set) var draining = false
+
+    public init(capacity: Int) {
+        precondition(capacity > 0, "invalid buffer capacity")
+        self.capacity = capacity
+        storage = UnsafeMutablePointer<UInt8>.allocate(capacity: 2 * capacity)
+        storage.initialize(repeating: 0, count: 2 * capacity)
+    }
+
+    deinit {
+        storage.deallocate()
+    }
+
+    /// Number of bytes that can still be appended without blocking.
+    public var available: Int {
+        return capacity - filled
+    }
+
+    /// `true` when nothing is staged and nothing is being drained.
+    public var isIdle: Bool {
+        return filled == 0 && !draining
+    }
+
+    /// Copies as much of `bytes` as fits into the filling half and returns
+    /// the number of bytes consumed.
+    public func append(_ bytes: UnsafeBufferPointer<UInt8>) -> Int {
+        guard let source = bytes.baseAddress else { return 0 }
+        let count = min(bytes.count, available)
+        (storage + fillingIndex * capacity + filled).assign(from: source, count: count)
+        filled += count
+        return count
+    }
+
+    /// Hands the filling half over to the DMA if the DMA is free and there
+    /// is something to send. Returns the region to transmit.
+    public func swap() -> UnsafeBufferPointer<UInt8>? {
+        guard !draining, filled > 0 else { return nil }
+        let region = UnsafeBufferPointer(start: storage + fillingIndex * capacity, count: filled)
+        fillingIndex ^= 1
+        filled = 0
+        draining = true
+        return region
+    }
+
+    /// Marks the half owned by the DMA as free again.
+    public func drainCompleted() {
+        draining = false
+    }
+
+    /// Drops everything that is staged or in flight.
+    public func reset() {
+        filled = 0
+        draining = false
+    }
+}
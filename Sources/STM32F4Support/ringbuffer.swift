@@ -0,0 +1,88 @@
+import CMemoryBarrier
+
+/// A lock-free single-producer/single-consumer queue.
+///
+/// One side (typically an interrupt handler) only calls `push`, the other
+/// side only calls `pop`/`read`. Each index is written by exactly one side,
+/// so neither needs to disable interrupts.
+public final class RingBuffer<Element> {
+    private let storage: UnsafeMutablePointer<Element>
+    private let mask: Int
+
+    /// Written by the producer only.
+    private var head = 0
+    /// Written by the consumer only.
+    private var tail = 0
+
+    /// The number of elements the buffer can hold (a power of two).
+    public let capacity: Int
+
+    /// Creates a buffer holding at least `capacity` elements.
+    public init(capacity: Int) {
+        precondition(capacity > 0, "invalid buffer capacity")
+        var size = 1
+        while size < capacity {
+            size <<= 1
+        }
+        self.capacity = size
+        mask = size - 1
+        storage = UnsafeMutablePointer<Element>.allocate(capacity: size)
+    }
+
+    deinit {
+        storage.deinitialize(count: count)
+        storage.deallocate()
+    }
+
+    public var count: Int {
+        return head &- tail
+    }
+
+    public var isEmpty: Bool {
+        return head == tail
+    }
+
+    public var isFull: Bool {
+        return count == capacity
+    }
+
+    /// Appends an element. Returns `false` if the buffer is full.
+    @discardableResult
+    public func push(_ element: Element) -> Bool {
+        let head = self.head
+        guard head &- tail < capacity else { return false }
+        (storage + (head & mask)).initialize(to: element)
+        // publish the element before the index
+        memory_barrier()
+        self.head = head &+ 1
+        return true
+    }
+
+    /// Removes the oldest element.
+    public func pop() -> Element? {
+        let tail = self.tail
+        guard head != tail else { return nil }
+        memory_barrier()
+        let element = (storage + (tail & mask)).move()
+        memory_barrier()
+        self.tail = tail &+ 1
+        return element
+    }
+
+    /// Moves up to `buffer.count` elements into `buffer`, returning how many
+    /// were moved.
+    public func read(into buffer: UnsafeMutableBufferPointer<Element>) -> Int {
+        guard let destination = buffer.baseAddress else { return 0 }
+        let tail = self.tail
+        let available = min(head &- tail, buffer.count)
+        guard available > 0 else { return 0 }
+        memory_barrier()
+        let start = tail & mask
+        let first = min(available, capacity - start)
+        destination.moveAssign(from: storage + start, count: first)
+        (destination + first).moveAssign(from: storage, count: available - first)
+        memory_barrier()
+        self.tail = tail &+ available
+        return available
+    }
+}
@@ -0,0 +1,262 @@
+/// A hierarchical timer wheel: `levels` wheels of 64 slots, each slot of a
+/// level spanning a whole revolution of the level below. A timer is filed
+/// by the highest base-64 digit in which its deadline differs from the
+/// current time, and moves down one level each time that digit is reached,
+/// so scheduling and cancelling are O(1) and each timer is touched at most
+/// once per level.
+///
+/// A 64-bit occupancy mask per level finds the next non-empty slot with one
+/// bit scan, so `advance` jumps straight from event to event instead of
+/// stepping through empty ticks.
+///
+/// Timers live in a pool allocated up front, linked into the slots by
+/// index. Time is in abstract ticks. The wheel is plain Swift and does not
+/// touch the hardware, see `SoftwareTimers` in STM32F4 for the driver.
+public final class TimerWheel<Payload> {
+    /// Identifies a scheduled timer. It goes stale once the timer has
+    /// fired (one-shot) or been cancelled.
+    public struct Timer: Equatable {
+        let index: Int32
+        let generation: UInt16
+    }
+
+    public static var levels: Int {
+        return 6
+    }
+
+    /// Deadlines further than 64^levels ticks wait in an overflow list,
+    /// checked once per top-level revolution.
+    private static var overflowBucket: Int {
+        return levels * 64
+    }
+
+    /// The time up to which timers have been processed.
+    public private(set) var now: UInt64
+
+    public let capacity: Int
+    public private(set) var count = 0
+
+    private let deadlines: UnsafeMutablePointer<UInt64>
+    private let periods: UnsafeMutablePointer<UInt64>
+    private let payloads: UnsafeMutablePointer<Payload?>
+    private let next: UnsafeMutablePointer<Int32>
+    private let previous: UnsafeMutablePointer<Int32>
+    /// The bucket holding each timer, -1 when free.
+    private let buckets: UnsafeMutablePointer<Int16>
+    private let generations: UnsafeMutablePointer<UInt16>
+
+    private let heads: UnsafeMutablePointer<Int32>
+    private let occupied: UnsafeMutablePointer<UInt64>
+    private var free: Int32
+
+    public init(capacity: Int, now: UInt64 = 0) {
+        precondition(capacity > 0 && capacity < Int(Int32.max), "invalid timer wheel capacity")
+        self.capacity = capacity
+        self.now = now
+        deadlines = UnsafeMutablePointer<UInt64>.allocate(capacity: capacity)
+        deadlines.initialize(repeating: 0, count: capacity)
+        periods = UnsafeMutablePointer<UInt64>.allocate(capacity: capacity)
+        periods.initialize(repeating: 0, count: capacity)
+        payloads = UnsafeMutablePointer<Payload?>.allocate(capacity: capacity)
+        payloads.initialize(repeating: nil, count: capacity)
+        next = UnsafeMutablePointer<Int32>.allocate(capacity: capacity)
+        previous = UnsafeMutablePointer<Int32>.allocate(capacity: capacity)
+        previous.initialize(repeating: -1, count: capacity)
+        buckets = UnsafeMutablePointer<Int16>.allocate(capacity: capacity)
+        buckets.initialize(repeating: -1, count: capacity)
+        generations = UnsafeMutablePointer<UInt16>.allocate(capacity: capacity)
+        generations.initialize(repeating: 0, count: capacity)
+        // the free list is chained through `next`
+        for index in 0..<capacity {
+            (next + index).initialize(to: index + 1 < capacity ? Int32(index + 1) : -1)
+        }
+        free = 0
+
+        heads = UnsafeMutablePointer<Int32>.allocate(capacity: TimerWheel.overflowBucket + 1)
+        heads.initialize(repeating: -1, count: TimerWheel.overflowBucket + 1)
+        occupied = UnsafeMutablePointer<UInt64>.allocate(capacity: TimerWheel.levels)
+        occupied.initialize(repeating: 0, count: TimerWheel.levels)
+    }
+
+    deinit {
+        deadlines.deallocate()
+        periods.deallocate()
+        payloads.deinitialize(count: capacity)
+        payloads.deallocate()
+        next.deallocate()
+        previous.deallocate()
+        buckets.deallocate()
+        generations.deallocate()
+        heads.deallocate()
+        occupied.deallocate()
+    }
+
+    /// Schedules `payload` for `deadline`, then every `period` ticks if
+    /// `period` is not zero. A deadline already passed fires on the next
+    /// `advance`. Returns `nil` when the pool is exhausted.
+    public func schedule(at deadline: UInt64, period: UInt64 = 0, _ payload: Payload) -> Timer? {
+        guard free >= 0 else { return nil }
+        let index = Int(free)
+        free = next[index]
+        deadlines[index] = max(deadline, now)
+        periods[index] = period
+        payloads[index] = payload
+        count += 1
+        insert(index)
+        return Timer(index: Int32(index), generation: generations[index])
+    }
+
+    /// Returns `false` if `timer` had already fired or been cancelled.
+    @discardableResult
+    public func cancel(_ timer: Timer) -> Bool {
+        guard isScheduled(timer) else { return false }
+        let index = Int(timer.index)
+        unlink(index)
+        release(index)
+        return true
+    }
+
+    public func isScheduled(_ timer: Timer) -> Bool {
+        let index = Int(timer.index)
+        return index >= 0 && index < capacity
+            && buckets[index] >= 0 && generations[index] == timer.generation
+    }
+
+    public func deadline(of timer: Timer) -> UInt64? {
+        return isScheduled(timer) ? deadlines[Int(timer.index)] : nil
+    }
+
+    /// The time at which `advance` next has work to do: a deadline, or an
+    /// earlier point where timers move down a level. `nil` when empty.
+    public var nextEvent: UInt64? {
+        guard count > 0 else { return nil }
+        var earliest = UInt64.max
+        for level in 0..<TimerWheel.levels {
+            let shift = UInt64(6 * level)
+            let position = Int((now >> shift) & 63)
+            // level 0 slots at the current position are due, higher levels
+            // only hold slots past it
+            let first = level == 0 ? position : position + 1
+            guard first < 64 else { continue }
+            let pending = occupied[level] & (~0 << UInt64(first))
+            guard pending != 0 else { continue }
+            let slot = UInt64(pending.trailingZeroBitCount)
+            let revolution = (now >> (shift + 6)) << (shift + 6)
+            earliest = min(earliest, revolution | slot << shift)
+        }
+        if heads[TimerWheel.overflowBucket] >= 0 {
+            let shift = UInt64(6 * TimerWheel.levels)
+            let (boundary, overflow) = ((now >> shift) + 1).multipliedReportingOverflow(by: 1 << shift)
+            if !overflow {
+                earliest = min(earliest, boundary)
+            }
+        }
+        return earliest == UInt64.max ? nil : earliest
+    }
+
+    /// Moves the wheel to `time`, calling `fire` for every timer due by
+    /// then, in deadline order. `fire` may schedule and cancel timers.
+    public func advance(to time: UInt64, _ fire: (Timer, Payload) -> Void) {
+        while let event = nextEvent, event <= time {
+            now = max(now, event)
+            if now & ((1 << UInt64(6 * TimerWheel.levels)) - 1) == 0 {
+                cascade(bucket: TimerWheel.overflowBucket)
+            }
+            // higher levels first, their timers may land in the level 0
+            // slot served right after
+            var level = TimerWheel.levels - 1
+            while level > 0 {
+                let shift = UInt64(6 * level)
+                if now & ((1 << shift) - 1) == 0 {
+                    cascade(bucket: level * 64 + Int((now >> shift) & 63))
+                }
+                level -= 1
+            }
+            let bucket = Int(now & 63)
+            while heads[bucket] >= 0 {
+                let index = Int(heads[bucket])
+                unlink(index)
+                let timer = Timer(index: Int32(index), generation: generations[index])
+                let payload = payloads[index]!
+                let period = periods[index]
+                if period > 0 {
+                    // keep the phase; skip the periods missed while late
+                    var deadline = deadlines[index] &+ period
+                    if deadline <= now {
+                        deadline = now + period - (now - deadlines[index]) % period
+                    }
+                    deadlines[index] = deadline
+                    insert(index)
+                } else {
+                    release(index)
+                }
+                fire(timer, payload)
+            }
+        }
+        now = max(now, time)
+    }
+
+    private func insert(_ index: Int) {
+        let deadline = deadlines[index]
+        let difference = deadline ^ now
+        let level = difference == 0 ? 0 : (63 - difference.leadingZeroBitCount) / 6
+        if level >= TimerWheel.levels {
+            link(index, bucket: TimerWheel.overflowBucket)
+        } else {
+            link(index, bucket: level * 64 + Int((deadline >> UInt64(6 * level)) & 63))
+        }
+    }
+
+    private func cascade(bucket: Int) {
+        var index = heads[bucket]
+        heads[bucket] = -1
+        if bucket < TimerWheel.overflowBucket {
+            occupied[bucket / 64] &= ~(1 << UInt64(bucket % 64))
+        }
+        while index >= 0 {
+            let following = next[Int(index)]
+            insert(Int(index))
+            index = following
+        }
+    }
+
+    private func link(_ index: Int, bucket: Int) {
+        let head = heads[bucket]
+        next[index] = head
+        previous[index] = -1
+        if head >= 0 {
+            previous[Int(head)] = Int32(index)
+        }
+        heads[bucket] = Int32(index)
+        buckets[index] = Int16(bucket)
+        if bucket < TimerWheel.overflowBucket {
+            occupied[bucket / 64] |= 1 << UInt64(bucket % 64)
+        }
+    }
+
+    private func unlink(_ index: Int) {
+        let bucket = Int(buckets[index])
+        let before = previous[index]
+        let after = next[index]
+        if before >= 0 {
+            next[Int(before)] = after
+        } else {
+            heads[bucket] = after
+            if after < 0 && bucket < TimerWheel.overflowBucket {
+                occupied[bucket / 64] &= ~(1 << UInt64(bucket % 64))
+            }
+        }
+        if after >= 0 {
+            previous[Int(after)] = before
+        }
+        buckets[index] = -1
+    }
+
+    private func release(_ index: Int) {
+        payloads[index] = nil
+        generations[index] &+= 1
+        next[index] = free
+        free = Int32(index)
+        count -= 1
+    }
+}
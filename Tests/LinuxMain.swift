@@ -0,0 +1,7 @@
+import XCTest
+
+import STM32F4SupportTests
+
+var tests = [XCTestCaseEntry]()
+tests += STM32F4SupportTests.allTests()
+XCTMain(tests)
@@ -0,0 +1,165 @@
+import XCTest
+@testable import STM32F4Support
+
+final class ClockTreeTests: XCTestCase {
+    private let hse8 = ClockTree.Source.hse(frequency: 8_000_000, bypass: true)
+    private let hse25 = ClockTree.Source.hse(frequency: 25_000_000, bypass: false)
+
+    private func assertPLL(_ tree: ClockTree?, m: Int, n: Int, p: Int, q: Int,
+                           file: StaticString = #file, line: UInt = #line) {
+        guard let tree = tree else {
+            return XCTFail("no clock tree", file: file, line: line)
+        }
+        XCTAssertEqual(tree.pllM, m, "M", file: file, line: line)
+        XCTAssertEqual(tree.pllN, n, "N", file: file, line: line)
+        XCTAssertEqual(tree.pllP, p, "P", file: file, line: line)
+        XCTAssertEqual(tree.pllQ, q, "Q", file: file, line: line)
+    }
+
+    func testDiscoveryIs168MHzWithUSB() {
+        let tree = ClockTree.discovery
+        assertPLL(tree, m: 4, n: 168, p: 2, q: 7)
+        XCTAssertEqual(tree.sysclk, 168_000_000)
+        XCTAssertEqual(tree.pll48, 48_000_000)
+        XCTAssertEqual(tree.pclk1, 42_000_000)
+        XCTAssertEqual(tree.pclk2, 84_000_000)
+        XCTAssertEqual(tree.flashLatency, 5)
+        XCTAssertEqual(tree.voltageScale, 1)
+        XCTAssertFalse(tree.overDrive)
+    }
+
+    func test180MHzFromHSE8NeedsOverDrive() {
+        let tree = ClockTree.solve(source: hse8, hclk: 180_000_000)
+        assertPLL(tree, m: 4, n: 180, p: 2, q: 8)
+        XCTAssertEqual(tree?.hclk, 180_000_000)
+        XCTAssertEqual(tree?.pclk1, 45_000_000)
+        XCTAssertEqual(tree?.pclk2, 90_000_000)
+        XCTAssertEqual(tree?.overDrive, true)
+        // Q keeps PLL48 at or below 48 MHz even without USB
+        XCTAssertEqual(tree?.pll48, 45_000_000)
+    }
+
+    func testHSE25() {
+        let usb = ClockTree.solve(source: hse25, hclk: 168_000_000, usb: true)
+        assertPLL(usb, m: 25, n: 336, p: 2, q: 7)
+        XCTAssertEqual(usb?.sysclk, 168_000_000)
+        XCTAssertEqual(usb?.pll48, 48_000_000)
+
+        // 25 / 13 would give the highest VCO input, but only 179.8 MHz
+        let fast = ClockTree.solve(source: hse25, hclk: 180_000_000)
+        assertPLL(fast, m: 15, n: 216, p: 2, q: 8)
+        XCTAssertEqual(fast?.sysclk, 180_000_000)
+    }
+
+    func testHSIOnly() {
+        let fast = ClockTree.solve(source: .hsi, hclk: 180_000_000)
+        assertPLL(fast, m: 8, n: 180, p: 2, q: 8)
+        XCTAssertEqual(fast?.overDrive, true)
+
+        let usb = ClockTree.solve(source: .hsi, hclk: 48_000_000, usb: true)
+        assertPLL(usb, m: 8, n: 96, p: 4, q: 4)
+        XCTAssertEqual(usb?.hclk, 48_000_000)
+        XCTAssertEqual(usb?.pll48, 48_000_000)
+        // APB1 is held to 42 MHz without over-drive
+        XCTAssertEqual(usb?.pclk1, 24_000_000)
+        XCTAssertEqual(usb?.pclk2, 48_000_000)
+    }
+
+    func testUSBHoldsPLL48At48MHz() {
+        // 180 MHz is no multiple of 48 MHz over an even P
+        let tree = ClockTree.solve(source: hse8, hclk: 180_000_000, usb: true)
+        assertPLL(tree, m: 4, n: 168, p: 2, q: 7)
+        XCTAssertEqual(tree?.pll48, 48_000_000)
+        XCTAssertEqual(tree?.overDrive, false)
+
+        let slow = ClockTree.solve(source: hse25, hclk: 24_000_000, usb: true)
+        assertPLL(slow, m: 25, n: 144, p: 6, q: 3)
+        XCTAssertEqual(slow?.sysclk, 24_000_000)
+        XCTAssertEqual(slow?.pll48, 48_000_000)
+
+        for target in stride(from: 24_000_000, through: 180_000_000, by: 4_000_000) {
+            for source in [hse8, hse25, .hsi] {
+                guard let tree = ClockTree.solve(source: source, hclk: target, usb: true) else {
+                    XCTFail("no USB tree for \(target) Hz")
+                    continue
+                }
+                XCTAssertEqual(tree.pll48, 48_000_000)
+                XCTAssertTrue((2...15).contains(tree.pllQ))
+                XCTAssertLessThanOrEqual(tree.hclk, target)
+            }
+        }
+    }
+
+    func testUnreachableTargets() {
+        // HSE outside 4-26 MHz
+        XCTAssertNil(ClockTree.solve(source: .hse(frequency: 3_000_000, bypass: false), hclk: 168_000_000))
+        XCTAssertNil(ClockTree.solve(source: .hse(frequency: 27_000_000, bypass: false), hclk: 168_000_000))
+        XCTAssertNil(ClockTree.solve(source: hse8, hclk: 0))
+        // 4.1 MHz reaches no multiple of 48 MHz with an integer N
+        let odd = ClockTree.Source.hse(frequency: 4_100_000, bypass: false)
+        XCTAssertNil(ClockTree.solve(source: odd, hclk: 168_000_000, usb: true))
+        XCTAssertNotNil(ClockTree.solve(source: odd, hclk: 168_000_000))
+    }
+
+    func testTargetsAreCappedByThePart() {
+        let tree = ClockTree.solve(source: hse8, hclk: 200_000_000, limits: .f40x)
+        assertPLL(tree, m: 4, n: 168, p: 2, q: 7)
+        XCTAssertEqual(tree?.overDrive, false)
+        XCTAssertEqual(tree?.voltageScale, 1)
+        XCTAssertEqual(ClockTree.solve(source: hse8, hclk: 200_000_000)?.sysclk, 180_000_000)
+    }
+
+    func testSlowClocksDivideOnAHB() {
+        let tree = ClockTree.solve(source: hse8, hclk: 1_000_000)
+        XCTAssertEqual(tree?.sysclk, 16_000_000)
+        XCTAssertEqual(tree?.ahbDivider, 16)
+        XCTAssertEqual(tree?.hclk, 1_000_000)
+    }
+
+    func testVoltageScaleBoundaries() {
+        let scales = [(120_000_000, 3), (122_000_000, 2), (144_000_000, 2), (146_000_000, 1)]
+        for (hclk, scale) in scales {
+            let tree = ClockTree.solve(source: hse8, hclk: hclk)
+            XCTAssertEqual(tree?.hclk, hclk)
+            XCTAssertEqual(tree?.voltageScale, scale, "\(hclk) Hz")
+        }
+        // the F40x regulator has no scale 3
+        XCTAssertEqual(ClockTree.solve(source: hse8, hclk: 100_000_000, limits: .f40x)?.voltageScale, 2)
+        // over-drive only above 168 MHz
+        XCTAssertEqual(ClockTree.solve(source: hse8, hclk: 168_000_000)?.overDrive, false)
+        XCTAssertEqual(ClockTree.solve(source: hse8, hclk: 169_000_000)?.overDrive, true)
+    }
+
+    func testFlashLatencyBoundaries() {
+        XCTAssertEqual(ClockTree.solve(source: hse8, hclk: 30_000_000)?.flashLatency, 0)
+        XCTAssertEqual(ClockTree.solve(source: hse8, hclk: 31_000_000)?.flashLatency, 1)
+        let latencies: [(ClockTree.VoltageRange, Int)] = [
+            (.from2V7to3V6, 5), (.from2V4to2V7, 6), (.from2V1to2V4, 7), (.from1V8to2V1, 8),
+        ]
+        for (voltage, latency) in latencies {
+            XCTAssertEqual(ClockTree.solve(source: hse8, hclk: 168_000_000, voltage: voltage)?.flashLatency,
+                           latency, "\(voltage)")
+        }
+    }
+
+    func testI2SSharesTheInputDivider() {
+        let tree = ClockTree.solve(source: hse8, hclk: 168_000_000, usb: true, i2s: 86_000_000)
+        XCTAssertEqual(tree?.pllI2SN, 86)
+        XCTAssertEqual(tree?.pllI2SR, 2)
+        XCTAssertEqual(tree?.i2s, 86_000_000)
+    }
+
+    static var allTests = [
+        ("testDiscoveryIs168MHzWithUSB", testDiscoveryIs168MHzWithUSB),
+        ("test180MHzFromHSE8NeedsOverDrive", test180MHzFromHSE8NeedsOverDrive),
+        ("testHSE25", testHSE25),
+        ("testHSIOnly", testHSIOnly),
+        ("testUSBHoldsPLL48At48MHz", testUSBHoldsPLL48At48MHz),
+        ("testUnreachableTargets", testUnreachableTargets),
+        ("testTargetsAreCappedByThePart", testTargetsAreCappedByThePart),
+        ("testSlowClocksDivideOnAHB", testSlowClocksDivideOnAHB),
+        ("testVoltageScaleBoundaries", testVoltageScaleBoundaries),
+        ("testFlashLatencyBoundaries", testFlashLatencyBoundaries),
+        ("testI2SSharesTheInputDivider", testI2SSharesTheInputDivider),
+    ]
+}
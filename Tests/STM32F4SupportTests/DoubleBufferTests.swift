@@ -0,0 +1,137 @@
+import Foundation
+import XCTest
+@testable import STM32F4Support
+
+final class DoubleBufferTests: XCTestCase {
+    private func append(_ bytes: [UInt8], to buffer: DoubleBuffer) -> Int {
+        return bytes.withUnsafeBufferPointer { buffer.append($0) }
+    }
+
+    func testAppendIsLimitedToOneHalf() {
+        let buffer = DoubleBuffer(capacity: 4)
+        XCTAssertEqual(append([1, 2, 3], to: buffer), 3)
+        XCTAssertEqual(append([4, 5, 6], to: buffer), 1)
+        XCTAssertEqual(buffer.available, 0)
+        XCTAssertEqual(Array(buffer.swap()!), [1, 2, 3, 4])
+    }
+
+    func testSwapNeedsDataAndAFreeDMA() {
+        let buffer = DoubleBuffer(capacity: 4)
+        XCTAssertTrue(buffer.isIdle)
+        XCTAssertNil(buffer.swap())
+
+        _ = append([1], to: buffer)
+        XCTAssertNotNil(buffer.swap())
+        _ = append([2], to: buffer)
+        // the first half is still draining
+        XCTAssertNil(buffer.swap())
+        XCTAssertFalse(buffer.isIdle)
+
+        buffer.drainCompleted()
+        XCTAssertEqual(Array(buffer.swap()!), [2])
+        buffer.drainCompleted()
+        XCTAssertTrue(buffer.isIdle)
+    }
+
+    func testAppendWhileDrainingLeavesTheDrainingHalfIntact() {
+        let buffer = DoubleBuffer(capacity: 4)
+        _ = append([1, 2, 3, 4], to: buffer)
+        let draining = buffer.swap()!
+        XCTAssertEqual(append([5, 6, 7, 8], to: buffer), 4)
+        XCTAssertEqual(Array(draining), [1, 2, 3, 4])
+        buffer.drainCompleted()
+        XCTAssertEqual(Array(buffer.swap()!), [5, 6, 7, 8])
+    }
+
+    func testDrainOrderMatchesAppendOrder() {
+        let buffer = DoubleBuffer(capacity: 5)
+        var sent: [UInt8] = []
+        var received: [UInt8] = []
+        var next: UInt8 = 0
+        for round in 0..<200 {
+            // appends of varying length, drained every few rounds
+            let chunk = (0..<(round % 7)).map { _ -> UInt8 in
+                next &+= 1
+                return next
+            }
+            let consumed = append(chunk, to: buffer)
+            sent += chunk[..<consumed]
+            if round % 3 == 0, let region = buffer.swap() {
+                received += region
+                buffer.drainCompleted()
+            }
+        }
+        while let region = buffer.swap() {
+            received += region
+            buffer.drainCompleted()
+        }
+        XCTAssertEqual(received, sent)
+    }
+
+    func testResetDropsStagedAndDrainingData() {
+        let buffer = DoubleBuffer(capacity: 4)
+        _ = append([1, 2], to: buffer)
+        _ = buffer.swap()
+        _ = append([3], to: buffer)
+        buffer.reset()
+        XCTAssertTrue(buffer.isIdle)
+        XCTAssertNil(buffer.swap())
+    }
+
+    /// A producer thread appends while a consumer thread swaps and drains,
+    /// as the application and the DMA interrupt do. The lock stands in for
+    /// masking interrupts; the drained region is read outside of it, as the
+    /// DMA does.
+    func testSwapUnderConcurrentAppend() {
+        let buffer = DoubleBuffer(capacity: 64)
+        let lock = NSLock()
+        let total = 200_000
+        var received: [UInt8] = []
+        received.reserveCapacity(total)
+
+        let producerDone = expectation(description: "producer")
+        let producer = Thread {
+            var sent = 0
+            var chunk = [UInt8](repeating: 0, count: 37)
+            while sent < total {
+                let length = min(chunk.count, total - sent)
+                for index in 0..<length {
+                    chunk[index] = UInt8(truncatingIfNeeded: sent + index)
+                }
+                lock.lock()
+                let consumed = chunk[..<length].withUnsafeBufferPointer { buffer.append($0) }
+                lock.unlock()
+                sent += consumed
+            }
+            producerDone.fulfill()
+        }
+        producer.start()
+
+        while received.count < total {
+            lock.lock()
+            let region = buffer.swap()
+            lock.unlock()
+            guard let drained = region else { continue }
+            received += drained
+            lock.lock()
+            buffer.drainCompleted()
+            lock.unlock()
+        }
+        wait(for: [producerDone], timeout: 10)
+
+        XCTAssertEqual(received.count, total)
+        for (index, byte) in received.enumerated() where byte != UInt8(truncatingIfNeeded: index) {
+            XCTFail("byte \(index) out of order")
+            break
+        }
+    }
+
+    static var allTests = [
+        ("testAppendIsLimitedToOneHalf", testAppendIsLimitedToOneHalf),
+        ("testSwapNeedsDataAndAFreeDMA", testSwapNeedsDataAndAFreeDMA),
+        ("testAppendWhileDrainingLeavesTheDrainingHalfIntact", testAppendWhileDrainingLeavesTheDrainingHalfIntact),
+        ("testDrainOrderMatchesAppendOrder", testDrainOrderMatchesAppendOrder),
+        ("testResetDropsStagedAndDrainingData", testResetDropsStagedAndDrainingData),
+        ("testSwapUnderConcurrentAppend", testSwapUnderConcurrentAppend),
+    ]
+}
@@ -0,0 +1,81 @@
+import Foundation
+import XCTest
+@testable import STM32F4Support
+
+final class RingBufferTests: XCTestCase {
+    func testCapacityIsRoundedUpToAPowerOfTwo() {
+        XCTAssertEqual(RingBuffer<Int>(capacity: 5).capacity, 8)
+        XCTAssertEqual(RingBuffer<Int>(capacity: 16).capacity, 16)
+    }
+
+    func testPushFailsWhenFull() {
+        let buffer = RingBuffer<Int>(capacity: 4)
+        for value in 0..<4 {
+            XCTAssertTrue(buffer.push(value))
+        }
+        XCTAssertTrue(buffer.isFull)
+        XCTAssertFalse(buffer.push(4))
+        XCTAssertEqual(buffer.pop(), 0)
+        XCTAssertTrue(buffer.push(4))
+        XCTAssertEqual((0..<4).map { _ in buffer.pop()! }, [1, 2, 3, 4])
+        XCTAssertNil(buffer.pop())
+    }
+
+    func testReadAcrossTheWrapAround() {
+        let buffer = RingBuffer<Int>(capacity: 8)
+        for value in 0..<6 {
+            buffer.push(value)
+        }
+        for _ in 0..<6 {
+            _ = buffer.pop()
+        }
+        for value in 0..<7 {
+            buffer.push(value)
+        }
+        var destination = [Int](repeating: -1, count: 10)
+        let count = destination.withUnsafeMutableBufferPointer { buffer.read(into: $0) }
+        XCTAssertEqual(count, 7)
+        XCTAssertEqual(Array(destination[..<count]), Array(0..<7))
+        XCTAssertTrue(buffer.isEmpty)
+    }
+
+    /// One producer and one consumer thread, without any lock.
+    func testSingleProducerSingleConsumer() {
+        let buffer = RingBuffer<Int>(capacity: 32)
+        let total = 500_000
+
+        let producerDone = expectation(description: "producer")
+        let producer = Thread {
+            var next = 0
+            while next < total {
+                if buffer.push(next) {
+                    next += 1
+                }
+            }
+            producerDone.fulfill()
+        }
+        producer.start()
+
+        var expected = 0
+        var outOfOrder = false
+        while expected < total {
+            guard let value = buffer.pop() else { continue }
+            if value != expected {
+                outOfOrder = true
+                break
+            }
+            expected += 1
+        }
+        wait(for: [producerDone], timeout: 10)
+
+        XCTAssertFalse(outOfOrder, "value \(expected) out of order")
+        XCTAssertTrue(buffer.isEmpty)
+    }
+
+    static var allTests = [
+        ("testCapacityIsRoundedUpToAPowerOfTwo", testCapacityIsRoundedUpToAPowerOfTwo),
+        ("testPushFailsWhenFull", testPushFailsWhenFull),
+        ("testReadAcrossTheWrapAround", testReadAcrossTheWrapAround),
+        ("testSingleProducerSingleConsumer", testSingleProducerSingleConsumer),
+    ]
+}
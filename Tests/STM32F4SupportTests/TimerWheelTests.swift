@@ -0,0 +1,200 @@
+import XCTest
+@testable import STM32F4Support
+
+/// A reproducible generator, so a failing random sequence can be replayed.
+private struct SplitMix64: RandomNumberGenerator {
+    var state: UInt64
+
+    mutating func next() -> UInt64 {
+        state &+= 0x9E37_79B9_7F4A_7C15
+        var z = state
+        z = (z ^ (z >> 30)) &* 0xBF58_476C_E5B9_E5B9
+        z = (z ^ (z >> 27)) &* 0x94D0_49BB_1331_11EB
+        return z ^ (z >> 31)
+    }
+}
+
+/// The timers a wheel should hold, kept as a plain dictionary and run by
+/// brute force.
+private struct ReferenceModel {
+    var timers: [Int: (deadline: UInt64, period: UInt64)] = [:]
+
+    /// The firings due up to `time`, as (time, key), in deadline order.
+    mutating func advance(to time: UInt64) -> [(UInt64, Int)] {
+        var fired: [(UInt64, Int)] = []
+        while let due = timers.filter({ $0.value.deadline <= time })
+            .min(by: { ($0.value.deadline, $0.key) < ($1.value.deadline, $1.key) }) {
+            fired.append((due.value.deadline, due.key))
+            if due.value.period > 0 {
+                timers[due.key]?.deadline = due.value.deadline + due.value.period
+            } else {
+                timers[due.key] = nil
+            }
+        }
+        return fired
+    }
+}
+
+final class TimerWheelTests: XCTestCase {
+    private func advance(_ wheel: TimerWheel<Int>, to time: UInt64) -> [(UInt64, Int)] {
+        var fired: [(UInt64, Int)] = []
+        wheel.advance(to: time) { _, key in
+            fired.append((wheel.now, key))
+        }
+        return fired
+    }
+
+    private func assertSameFirings(_ fired: [(UInt64, Int)], _ expected: [(UInt64, Int)],
+                                   file: StaticString = #file, line: UInt = #line) {
+        // the order among timers due at the same tick is unspecified
+        let sort = { (firings: [(UInt64, Int)]) in firings.sorted { ($0.0, $0.1) < ($1.0, $1.1) } }
+        XCTAssertEqual(sort(fired).map { $0.0 }, sort(expected).map { $0.0 }, "times", file: file, line: line)
+        XCTAssertEqual(sort(fired).map { $0.1 }, sort(expected).map { $0.1 }, "timers", file: file, line: line)
+        XCTAssertEqual(fired.map { $0.0 }, fired.map { $0.0 }.sorted(), "out of order", file: file, line: line)
+    }
+
+    func testTimersFireOnTheirTickAtEveryLevel() {
+        let wheel = TimerWheel<Int>(capacity: 8)
+        // one deadline per level, the last one in the overflow list
+        let deadlines: [UInt64] = [5, 64 + 3, 64 * 64 + 7, 3 << 18 + 1, 5 << 24 + 9, 7 << 30 + 2, 1 << 36 + 11]
+        for (key, deadline) in deadlines.enumerated() {
+            XCTAssertNotNil(wheel.schedule(at: deadline, key))
+        }
+        var fired: [(UInt64, Int)] = []
+        while let event = wheel.nextEvent {
+            XCTAssertGreaterThanOrEqual(event, wheel.now)
+            fired += advance(wheel, to: event)
+        }
+        assertSameFirings(fired, deadlines.enumerated().map { ($0.element, $0.offset) })
+        XCTAssertEqual(wheel.count, 0)
+        XCTAssertNil(wheel.nextEvent)
+    }
+
+    func testCascadeAcrossLevelsInOneJump() {
+        let wheel = TimerWheel<Int>(capacity: 8)
+        _ = wheel.schedule(at: 1 << 30 + 1 << 24 + 1 << 18 + 1 << 12 + 1 << 6 + 1, 0)
+        _ = wheel.schedule(at: 1 << 30, 1)
+        _ = wheel.schedule(at: 1 << 30 - 1, 2)
+        // a single advance crosses every cascade point
+        assertSameFirings(advance(wheel, to: UInt64.max >> 1),
+                          [(1 << 30 - 1, 2), (1 << 30, 1), (1 << 30 + 1 << 24 + 1 << 18 + 1 << 12 + 1 << 6 + 1, 0)])
+    }
+
+    /// Timers filed in the bucket that cascades at 4096 are cancelled by
+    /// the first of them to fire: its partner on the same tick, one moved
+    /// to the next level 0 slot and one moved to level 1.
+    func testCancelDuringCascade() {
+        let wheel = TimerWheel<Int>(capacity: 8)
+        var timers: [Int: TimerWheel<Int>.Timer] = [:]
+        timers[0] = wheel.schedule(at: 4096, 0)
+        timers[1] = wheel.schedule(at: 4096, 1)
+        timers[2] = wheel.schedule(at: 4097, 2)
+        timers[3] = wheel.schedule(at: 4096 + 64, 3)
+        // not cancelled: a later level 2 slot
+        timers[4] = wheel.schedule(at: 2 * 4096, 4)
+
+        var fired: [Int] = []
+        wheel.advance(to: 3 * 4096) { _, key in
+            fired.append(key)
+            if key < 2 {
+                XCTAssertTrue(wheel.cancel(timers[1 - key]!))
+                XCTAssertTrue(wheel.cancel(timers[2]!))
+                XCTAssertTrue(wheel.cancel(timers[3]!))
+                // due at once, fired by this same advance
+                _ = wheel.schedule(at: wheel.now, 5)
+            }
+        }
+        XCTAssertEqual(fired.count, 3)
+        XCTAssertTrue(fired[0] < 2)
+        XCTAssertEqual(Array(fired[1...]), [5, 4])
+        XCTAssertEqual(wheel.count, 0)
+    }
+
+    func testCancelledHandlesGoStale() {
+        let wheel = TimerWheel<Int>(capacity: 1)
+        let first = wheel.schedule(at: 100, 0)!
+        XCTAssertNil(wheel.schedule(at: 100, 1))
+        XCTAssertTrue(wheel.cancel(first))
+        XCTAssertFalse(wheel.cancel(first))
+        // the slot is reused with a new generation
+        let second = wheel.schedule(at: 200, 2)!
+        XCTAssertFalse(wheel.isScheduled(first))
+        XCTAssertNil(wheel.deadline(of: first))
+        XCTAssertEqual(wheel.deadline(of: second), 200)
+    }
+
+    /// `SoftwareTimers` extends a 32 bit counter, so the wheel must carry
+    /// timers across 2^32 like any other tick.
+    func testAcross32BitWrap() {
+        let start = UInt64(1) << 32 - 100
+        let wheel = TimerWheel<Int>(capacity: 8, now: start)
+        var model = ReferenceModel()
+        let timers: [(UInt64, UInt64)] = [(1 << 32 - 1, 0), (1 << 32, 0), (1 << 32 + 1, 0),
+                                          (1 << 32 + 5000, 0), (1 << 32 - 50, 7)]
+        for (key, (deadline, period)) in timers.enumerated() {
+            _ = wheel.schedule(at: deadline, period: period, key)
+            model.timers[key] = (deadline, period)
+        }
+        var time = start
+        for step in [1, 49, 50, 1, 3, 4096, 100, 1000] as [UInt64] {
+            time += step
+            assertSameFirings(advance(wheel, to: time), model.advance(to: time))
+        }
+        XCTAssertEqual(wheel.count, 1)
+    }
+
+    /// Random schedules, cancels and advances against the reference model,
+    /// starting at 0, around 2^32 and just below the overflow list boundary.
+    func testAgainstReferenceModel() {
+        var random = SplitMix64(state: 1)
+        for trial in 0..<60 {
+            let starts: [UInt64] = [0, 1 << 32 - 7, 1 << 36 - 5, random.next() >> 24]
+            let start = starts[trial % starts.count]
+            let wheel = TimerWheel<Int>(capacity: 200, now: start)
+            var model = ReferenceModel()
+            var handles: [Int: TimerWheel<Int>.Timer] = [:]
+            var now = start
+            var nextKey = 0
+
+            for _ in 0..<200 {
+                let choice = Int.random(in: 0..<10, using: &random)
+                if choice < 5 && wheel.count < wheel.capacity {
+                    let delays: [UInt64] = [0, 1, .random(in: 0..<100, using: &random),
+                                            .random(in: 0..<5000, using: &random),
+                                            .random(in: 0..<1 << 20, using: &random),
+                                            .random(in: 0..<1 << 38, using: &random)]
+                    let deadline = now + delays.randomElement(using: &random)!
+                    let period: UInt64 = Int.random(in: 0..<4, using: &random) == 0
+                        ? .random(in: 1..<3000, using: &random) : 0
+                    handles[nextKey] = wheel.schedule(at: deadline, period: period, nextKey)
+                    model.timers[nextKey] = (deadline, period)
+                    nextKey += 1
+                } else if choice < 6, let key = model.timers.keys.randomElement(using: &random) {
+                    XCTAssertEqual(wheel.deadline(of: handles[key]!), model.timers[key]!.deadline)
+                    XCTAssertTrue(wheel.cancel(handles[key]!))
+                    model.timers[key] = nil
+                } else {
+                    // periodic timers bound the jump, or it would fire them
+                    // millions of times
+                    let periodic = model.timers.values.contains { $0.period > 0 }
+                    let steps: [UInt64] = [0, 1, .random(in: 0..<200, using: &random),
+                                           .random(in: 0..<(periodic ? 1 << 12 : 1 << 21), using: &random),
+                                           periodic ? 5 : UInt64.random(in: 0..<1 << 39, using: &random)]
+                    now += steps.randomElement(using: &random)!
+                    assertSameFirings(advance(wheel, to: now), model.advance(to: now))
+                    XCTAssertEqual(wheel.now, now)
+                }
+                XCTAssertEqual(wheel.count, model.timers.count)
+            }
+        }
+    }
+
+    static var allTests = [
+        ("testTimersFireOnTheirTickAtEveryLevel", testTimersFireOnTheirTickAtEveryLevel),
+        ("testCascadeAcrossLevelsInOneJump", testCascadeAcrossLevelsInOneJump),
+        ("testCancelDuringCascade", testCancelDuringCascade),
+        ("testCancelledHandlesGoStale", testCancelledHandlesGoStale),
+        ("testAcross32BitWrap", testAcross32BitWrap),
+        ("testAgainstReferenceModel", testAgainstReferenceModel),
+    ]
+}
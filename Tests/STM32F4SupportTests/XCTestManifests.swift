@@ -0,0 +1,12 @@
+import XCTest
+
+#if !canImport(ObjectiveC)
+public func allTests() -> [XCTestCaseEntry] {
+    return [
+        testCase(ClockTreeTests.allTests),
+        testCase(DoubleBufferTests.allTests),
+        testCase(RingBufferTests.allTests),
+        testCase(TimerWheelTests.allTests),
+    ]
+}
+#endif